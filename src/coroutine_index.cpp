@@ -0,0 +1,114 @@
+#include "coroutine_index.hpp"
+
+#include "settings.hpp"
+
+#include <algorithm>
+
+#include <lldb/API/SBTarget.h>
+
+namespace llc2 {
+
+namespace {
+
+struct CachedIndex final {
+  std::uint32_t process_id{};
+  std::uint32_t stop_id{};
+  // A new LLC2Settings may well be allocated where the old one was, so
+  // everything discovery depends on is compared as well.
+  const LLC2Settings* settings{};
+  std::size_t stack_size{};
+  bool with_magic{};
+  ContextImplementation context_implementation{};
+  std::vector<IndexedCoroutine> coroutines;
+};
+
+std::optional<CachedIndex> cached_index;
+
+}  // namespace
+
+const std::vector<IndexedCoroutine>* GetCoroutineIndex(
+    lldb::SBDebugger& debugger, lldb::SBProcess& process,
+    const CoroDecoder& decoder, lldb::SBCommandReturnObject& result) {
+  // We already validated that settings aren't null
+  const auto& settings = *GetSettings();
+
+  const auto process_id = process.GetUniqueID();
+  const auto stop_id = process.GetStopID();
+  if (cached_index.has_value() && cached_index->process_id == process_id &&
+      cached_index->stop_id == stop_id &&
+      cached_index->settings == &settings &&
+      cached_index->stack_size == settings.stack_size &&
+      cached_index->with_magic == settings.with_magic &&
+      cached_index->context_implementation ==
+          settings.context_implementation) {
+    return &cached_index->coroutines;
+  }
+  cached_index.reset();
+
+  auto target = process.GetTarget();
+  TaskContextReader task_context_reader{target, result};
+  auto task_context_type = target.FindFirstType(kTaskContextTypeName);
+
+  auto interpreter = debugger.GetCommandInterpreter();
+  std::vector<IndexedCoroutine> coroutines;
+  for (const auto& region : GetCandidateStacks(process, result)) {
+    if (interpreter.WasInterrupted()) {
+      return nullptr;
+    }
+
+    const auto stack = TryInspectStack(process, result, decoder, region);
+    if (!stack.has_value()) {
+      continue;
+    }
+
+    IndexedCoroutine coroutine{};
+    coroutine.stack = *stack;
+    coroutine.registers = TryReadRegisters(process, result, decoder, *stack);
+
+    if (stack->task_context != 0 && task_context_reader.IsValid()) {
+      const auto state = task_context_reader.ReadState(stack->task_context);
+      const auto* state_name =
+          state.has_value() ? task_context_reader.GetStateName(*state)
+                            : nullptr;
+      if (state_name != nullptr) {
+        coroutine.task_state.emplace(state_name);
+      }
+      coroutine.idle = IsFinishedTaskState(state_name) && stack->IsSuspended();
+      if (!coroutine.idle) {
+        coroutine.task_processor =
+            task_context_reader.ReadTaskProcessorName(stack->task_context);
+      }
+
+      if (stack->IsSuspended() && state_name != nullptr &&
+          kSuspendedTaskState == state_name) {
+        coroutine.span = ReadSpanInfo(
+            GetTaskContextValue(target, task_context_type,
+                                stack->task_context),
+            process, result);
+      }
+    }
+
+    coroutines.push_back(std::move(coroutine));
+  }
+
+  cached_index.emplace(CachedIndex{
+      process_id, stop_id, &settings, settings.stack_size, settings.with_magic,
+      settings.context_implementation, std::move(coroutines)});
+  return &cached_index->coroutines;
+}
+
+const IndexedCoroutine* FindCoroutine(
+    const std::vector<IndexedCoroutine>& coroutines,
+    std::uintptr_t stack_address) {
+  const auto it = std::lower_bound(
+      coroutines.begin(), coroutines.end(), stack_address,
+      [](const auto& coroutine, std::uintptr_t value) {
+        return coroutine.stack.GetStackAddress() < value;
+      });
+  if (it == coroutines.end() || it->stack.GetStackAddress() != stack_address) {
+    return nullptr;
+  }
+  return &*it;
+}
+
+}  // namespace llc2
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "discovery.hpp"
+#include "userver.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <lldb/API/SBCommandReturnObject.h>
+#include <lldb/API/SBDebugger.h>
+#include <lldb/API/SBProcess.h>
+
+namespace llc2 {
+
+// Everything known about a coroutine stack without unwinding it.
+struct IndexedCoroutine final {
+  StackInfo stack;
+  // only for suspended coroutines
+  std::optional<UnwindRegisters> registers;
+  std::optional<std::string> task_processor;
+  // Task::State name of the TaskContext coroutine was last resumed with
+  std::optional<std::string> task_state;
+  // Suspended coroutine back in the pool, its TaskContext is a leftover
+  bool idle{false};
+  // only for tasks sleeping in TaskContext::Sleep
+  std::optional<SpanInfo> span;
+};
+
+// Coroutines of the process as of its current stop, sorted by stack address.
+// The scan is done on first use and reused until the process resumes or
+// settings change, so that scripts can query coroutines as many times as
+// they like for the price of a single scan. Returns null if the scan was
+// interrupted, partial results are not cached.
+const std::vector<IndexedCoroutine>* GetCoroutineIndex(
+    lldb::SBDebugger& debugger, lldb::SBProcess& process,
+    const CoroDecoder& decoder, lldb::SBCommandReturnObject& result);
+
+// Returns the coroutine with this stack address, if any.
+const IndexedCoroutine* FindCoroutine(
+    const std::vector<IndexedCoroutine>& coroutines,
+    std::uintptr_t stack_address);
+
+}  // namespace llc2
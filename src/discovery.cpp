@@ -0,0 +1,640 @@
+#include "discovery.hpp"
+
+#include "settings.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include <lldb/API/SBCommandInterpreter.h>
+#include <lldb/API/SBDebugger.h>
+#include <lldb/API/SBError.h>
+#include <lldb/API/SBMemoryRegionInfo.h>
+#include <lldb/API/SBMemoryRegionInfoList.h>
+#include <lldb/API/SBTarget.h>
+#include <lldb/API/SBType.h>
+
+namespace llc2 {
+
+namespace {
+
+// Layouts below are the ones of boost.Coroutine2 we know how to decode. Which
+// one the target uses is detected once per process, from its debug info when
+// there is some, and every layout gets its own instantiation of the decoders,
+// so reading a coroutine never checks which layout it deals with.
+
+// This struct mimics that of boost.Coroutine2, patched to have a magic
+struct CoroControlBlockWithMagic final {
+  std::size_t magic{0};
+  void* fiber{};
+  void* other{};  // this is pull_coroutine
+  state_t state{};
+  void* except{};  // this is std::exception_ptr
+
+  static constexpr bool kHasMagic = true;
+  static constexpr std::size_t kMagic = 0x12345678;
+};
+
+// This struct mimics that of boost.Coroutine2
+struct CoroControlBlock final {
+  void* fiber{};
+  void* other{};  // this is pull_coroutine
+  state_t state{};
+  void* except{};  // this is std::exception_ptr
+
+  static constexpr bool kHasMagic = false;
+};
+
+// This struct mimics that of boost.Coroutine2: it's the
+// pull_coroutine<T>::control_block, which lives on coroutine stack and
+// 'other' of the control blocks above points to it.
+struct PullCoroControlBlock final {
+  void* fiber{};
+  void* other{};  // this is push_coroutine
+  state_t state{};
+  void* except{};  // this is std::exception_ptr
+  bool bvalid{false};
+  void* storage{};  // this is T, and T is TaskContext* for uServer
+};
+
+// Used instead of PullCoroControlBlock when debug info says the target's one
+// is different: we still find coroutines, but not their TaskContext.
+struct UnknownPullCoroControlBlock final {};
+
+// Not a layout, boost hardcodes it in push_coroutine constructor:
+// "constexpr std::size_t func_alignment = 64; // alignof( control_block);"
+constexpr std::size_t kControlBlockAlignment = 64;
+
+// Offset of ucontext_t in boost::context::detail::fiber_activation_record,
+// which is polymorphic, so ucontext_t follows the vtable pointer.
+constexpr std::size_t kDefaultUcontextOffset = 8;
+
+// Push control block of uServer coroutines, spelled either way LLDB might.
+constexpr const char* kPushControlBlockTypeNames[] = {
+    "boost::coroutines2::detail::push_coroutine<"
+    "userver::engine::impl::TaskContext *>::control_block",
+    "boost::coroutines2::detail::push_coroutine<"
+    "userver::engine::impl::TaskContext*>::control_block",
+};
+
+constexpr const char* kPullControlBlockTypeNames[] = {
+    "boost::coroutines2::detail::pull_coroutine<"
+    "userver::engine::impl::TaskContext *>::control_block",
+    "boost::coroutines2::detail::pull_coroutine<"
+    "userver::engine::impl::TaskContext*>::control_block",
+};
+
+constexpr const char* kFiberActivationRecordTypeName =
+    "boost::context::detail::fiber_activation_record";
+
+template <typename PullControlBlock>
+std::uintptr_t ReadTaskContextPointer(lldb::SBProcess& process,
+                                      lldb::SBCommandReturnObject& result,
+                                      void* pull_control_block_ptr) {
+  if constexpr (std::is_same_v<PullControlBlock,
+                               UnknownPullCoroControlBlock>) {
+    return 0;
+  } else {
+    // coroutine hasn't been started yet
+    if (pull_control_block_ptr == nullptr) {
+      return 0;
+    }
+
+    PullControlBlock control_block{};
+    lldb::SBError error{};
+    process.ReadMemory(
+        reinterpret_cast<std::uintptr_t>(pull_control_block_ptr),
+        &control_block, sizeof(PullControlBlock), error);
+    if (!error.Success()) {
+      result.Printf(
+          "Failed to read pull_coroutine::control_block from process memory: "
+          "%s\n",
+          error.GetCString());
+      return 0;
+    }
+
+    if (!control_block.bvalid) {
+      return 0;
+    }
+    return reinterpret_cast<std::uintptr_t>(control_block.storage);
+  }
+}
+
+template <typename ControlBlock, typename PullControlBlock>
+std::optional<StackInfo> InspectStack(lldb::SBProcess& process,
+                                      lldb::SBCommandReturnObject& result,
+                                      const RegionInfo& region_info,
+                                      const LLC2Settings& settings) {
+  constexpr std::size_t func_alignment = kControlBlockAlignment;
+  constexpr std::size_t func_size = sizeof(ControlBlock);
+
+  // reserve space on stack
+  void* sp =
+      reinterpret_cast<char*>(region_info.end) - func_size - func_alignment;
+  // align sp pointer
+  std::size_t space = func_size + func_alignment;
+  sp = std::align(func_alignment, func_size, sp, space);
+  // sp is where coroutine::control_block is allocated on stack
+
+  ControlBlock control_block{};
+  lldb::SBError error{};
+  process.ReadMemory(reinterpret_cast<std::uintptr_t>(sp), &control_block,
+                     sizeof(ControlBlock), error);
+  if (!error.Success()) {
+    result.Printf(
+        "Failed to read Coro::control_block from process memory: %s\n",
+        error.GetCString());
+    return std::nullopt;
+  }
+
+  if constexpr (ControlBlock::kHasMagic) {
+    const auto remaining_size =
+        settings.GetMmapSize() -
+        (reinterpret_cast<char*>(region_info.end) - static_cast<char*>(sp));
+    const auto expected_magic = ControlBlock::kMagic ^
+                                reinterpret_cast<std::uintptr_t>(sp) ^
+                                remaining_size;
+    if (control_block.magic != expected_magic) {
+      result.Printf("Magic doesn't match: expected %lu, got %lu\n",
+                    expected_magic, control_block.magic);
+      return std::nullopt;
+    }
+  } else {
+    static_cast<void>(settings);
+  }
+
+  return StackInfo{region_info, control_block.state,
+                   ReadTaskContextPointer<PullControlBlock>(
+                       process, result, control_block.other),
+                   control_block.fiber};
+}
+
+std::optional<UnwindRegisters> TryGetRegistersFromUcontext(
+    lldb::SBProcess& process, lldb::SBCommandReturnObject& result,
+    void* fiber_ptr, std::size_t ucontext_offset) {
+  lldb::SBError error{};
+  ucontext_t context{};
+  // fiber_ptr points to fiber_activation_record, ucontext_t is its 'uctx'
+  process.ReadMemory(reinterpret_cast<std::uintptr_t>(fiber_ptr) +
+                         ucontext_offset,
+                     &context, sizeof(ucontext_t), error);
+  if (!error.Success()) {
+    result.Printf("Failed to read ucontext from process memory: %s\n",
+                  error.GetCString());
+    return std::nullopt;
+  }
+
+#if __APPLE__
+  _STRUCT_MCONTEXT data{};
+  process.ReadMemory(reinterpret_cast<std::uintptr_t>(context.uc_mcontext),
+                     &data, sizeof(_STRUCT_MCONTEXT), error);
+  if (!error.Success()) {
+    result.Printf("Failed to read ucontext from process memory: %s\n",
+                  error.GetCString());
+    return std::nullopt;
+  }
+
+  return UnwindRegisters{static_cast<std::int64_t>(data.__ss.__rsp),
+                         static_cast<std::int64_t>(data.__ss.__rbp),
+                         static_cast<std::int64_t>(data.__ss.__rip)};
+#elif __linux__
+  return UnwindRegisters{context};
+#endif
+}
+
+// This layout is defined by make_fcontext/jump_fcontext assembly rather than
+// by a C++ type, so there is nothing to detect from debug info.
+// clang-format off
+/****************************************************************************************
+ *                                                                                      *
+ *  ----------------------------------------------------------------------------------  *
+ *  |    0    |    1    |    2    |    3    |    4     |    5    |    6    |    7    |  *
+ *  ----------------------------------------------------------------------------------  *
+ *  |   0x0   |   0x4   |   0x8   |   0xc   |   0x10   |   0x14  |   0x18  |   0x1c  |  *
+ *  ----------------------------------------------------------------------------------  *
+ *  | fc_mxcsr|fc_x87_cw|        R12        |         R13        |        R14        |  *
+ *  ----------------------------------------------------------------------------------  *
+ *  ----------------------------------------------------------------------------------  *
+ *  |    8    |    9    |   10    |   11    |    12    |    13   |    14   |    15   |  *
+ *  ----------------------------------------------------------------------------------  *
+ *  |   0x20  |   0x24  |   0x28  |  0x2c   |   0x30   |   0x34  |   0x38  |   0x3c  |  *
+ *  ----------------------------------------------------------------------------------  *
+ *  |        R15        |        RBX        |         RBP        |        RIP        |  *
+ *  ----------------------------------------------------------------------------------  *
+ *                                                                                      *
+ ****************************************************************************************/
+// clang-format on
+std::optional<UnwindRegisters> TryGetRegistersFromFcontext(
+    lldb::SBProcess& process, lldb::SBCommandReturnObject& result,
+    void* fiber_ptr, std::size_t ucontext_offset) {
+  static_cast<void>(ucontext_offset);
+  constexpr std::size_t kContextDataSize = 0x40;
+
+  char context_data[kContextDataSize];
+  lldb::SBError error{};
+  // so fiber_ptr is a detail::fcontext_t, which in turn is just a void*.
+  process.ReadMemory(reinterpret_cast<std::uintptr_t>(fiber_ptr), &context_data,
+                     kContextDataSize, error);
+  if (!error.Success()) {
+    result.Printf("Failed to read fcontext from process memory: %s\n",
+                  error.GetCString());
+    return std::nullopt;
+  }
+
+  const auto read_with_offset = [&context_data](std::size_t offset) {
+    return *reinterpret_cast<std::int64_t*>(&context_data[offset]);
+  };
+
+  // with fcontext fiber_ptr is a pointer to context data,
+  // detail::jump_fcontext populate registers from it and sets rsp to it + 0x40
+  const auto rsp = reinterpret_cast<std::int64_t>(fiber_ptr) + kContextDataSize;
+  const auto rbp = read_with_offset(0x30);
+  const auto rip = read_with_offset(0x38);
+
+  return UnwindRegisters(rsp, rbp, rip);
+}
+
+using InspectStackFn = std::optional<StackInfo> (*)(
+    lldb::SBProcess&, lldb::SBCommandReturnObject&, const RegionInfo&,
+    const LLC2Settings&);
+using ReadRegistersFn = std::optional<UnwindRegisters> (*)(
+    lldb::SBProcess&, lldb::SBCommandReturnObject&, void*, std::size_t);
+
+}  // namespace
+
+// Decoders for the layout of a particular process.
+struct CoroDecoder final {
+  InspectStackFn inspect_stack{};
+  ReadRegistersFn read_registers{};
+  // where ucontext_t is in fiber_activation_record, for ucontext
+  std::size_t ucontext_offset{kDefaultUcontextOffset};
+  const LLC2Settings* settings{};
+};
+
+namespace {
+
+lldb::SBType FindFirstType(lldb::SBTarget& target,
+                           const char* const (&names)[2]) {
+  for (const auto* name : names) {
+    auto type = target.FindFirstType(name);
+    if (type.IsValid()) {
+      return type;
+    }
+  }
+  return {};
+}
+
+std::optional<std::uint64_t> GetFieldOffset(lldb::SBType type,
+                                            std::string_view name) {
+  const auto field = FindField(type, name);
+  if (!field.has_value()) {
+    return std::nullopt;
+  }
+  return field->offset;
+}
+
+// boost.Coroutine2 names it 'c', the name is kept in case a patched one
+// spells it out.
+std::optional<std::uint64_t> GetFiberOffset(lldb::SBType type) {
+  for (const auto name : {"c", "fiber"}) {
+    if (const auto offset = GetFieldOffset(type, name); offset.has_value()) {
+      return offset;
+    }
+  }
+  return std::nullopt;
+}
+
+// push_coroutine<T>::control_block as debug info describes it.
+struct PushLayout final {
+  std::uint64_t size{};
+  std::uint64_t fiber{};
+  std::uint64_t other{};
+  std::uint64_t state{};
+};
+
+// Returns nullopt if debug info doesn't have one of the fields, which tells
+// nothing about the layout.
+std::optional<PushLayout> GetPushLayout(lldb::SBType type) {
+  const auto fiber = GetFiberOffset(type);
+  const auto other = GetFieldOffset(type, "other");
+  const auto state = GetFieldOffset(type, "state");
+  if (!fiber.has_value() || !other.has_value() || !state.has_value()) {
+    return std::nullopt;
+  }
+  return PushLayout{type.GetByteSize(), *fiber, *other, *state};
+}
+
+template <typename ControlBlock>
+bool IsPushLayout(const PushLayout& layout) {
+  return layout.size == sizeof(ControlBlock) &&
+         layout.fiber == offsetof(ControlBlock, fiber) &&
+         layout.other == offsetof(ControlBlock, other) &&
+         layout.state == offsetof(ControlBlock, state);
+}
+
+// Returns nullopt if debug info doesn't have one of the fields.
+std::optional<bool> IsPullLayout(lldb::SBType type) {
+  const auto other = GetFieldOffset(type, "other");
+  const auto bvalid = GetFieldOffset(type, "bvalid");
+  const auto storage = GetFieldOffset(type, "storage");
+  if (!other.has_value() || !bvalid.has_value() || !storage.has_value()) {
+    return std::nullopt;
+  }
+  return *other == offsetof(PullCoroControlBlock, other) &&
+         *bvalid == offsetof(PullCoroControlBlock, bvalid) &&
+         *storage == offsetof(PullCoroControlBlock, storage);
+}
+
+template <typename ControlBlock>
+InspectStackFn SelectInspectStack(bool known_pull_layout) {
+  return known_pull_layout
+             ? &InspectStack<ControlBlock, PullCoroControlBlock>
+             : &InspectStack<ControlBlock, UnknownPullCoroControlBlock>;
+}
+
+// Picks decoders for the target's boost.Coroutine2, trusting its debug info
+// over settings. Returns nullopt if debug info describes a layout we don't
+// know, since guessing would only produce garbage, and error says what it
+// is. Debug info without the fields we look for describes nothing, and
+// settings are used then.
+std::optional<CoroDecoder> DetectDecoder(lldb::SBProcess& process,
+                                         lldb::SBCommandReturnObject& result,
+                                         const LLC2Settings& settings,
+                                         std::string& error) {
+  auto target = process.GetTarget();
+
+  bool with_magic = settings.with_magic;
+  auto push_type = FindFirstType(target, kPushControlBlockTypeNames);
+  const auto push_layout = push_type.IsValid()
+                               ? GetPushLayout(push_type)
+                               : std::optional<PushLayout>{};
+  if (push_type.IsValid() && !push_layout.has_value()) {
+    result.Printf(
+        "Debug info of push_coroutine::control_block doesn't have the "
+        "expected fields, using layout from 'llc2 init'\n");
+  }
+  if (push_layout.has_value()) {
+    if (IsPushLayout<CoroControlBlock>(*push_layout)) {
+      with_magic = false;
+    } else if (IsPushLayout<CoroControlBlockWithMagic>(*push_layout)) {
+      with_magic = true;
+    } else {
+      char buffer[160];
+      std::snprintf(
+          buffer, sizeof(buffer),
+          "Unsupported push_coroutine::control_block layout: size %lu, fiber "
+          "at %lu, other at %lu, state at %lu",
+          static_cast<unsigned long>(push_layout->size),
+          static_cast<unsigned long>(push_layout->fiber),
+          static_cast<unsigned long>(push_layout->other),
+          static_cast<unsigned long>(push_layout->state));
+      error = buffer;
+      return std::nullopt;
+    }
+    if (with_magic != settings.with_magic) {
+      result.Printf(
+          "Debug info says control_block is %s magic, ignoring 'llc2 init "
+          "-m'\n",
+          with_magic ? "with" : "without");
+    }
+  }
+
+  bool known_pull_layout = true;
+  auto pull_type = FindFirstType(target, kPullControlBlockTypeNames);
+  if (pull_type.IsValid() && !IsPullLayout(pull_type).value_or(true)) {
+    result.Printf(
+        "Unsupported pull_coroutine::control_block layout, tasks of "
+        "coroutines are not available\n");
+    known_pull_layout = false;
+  }
+
+  CoroDecoder decoder{};
+  decoder.settings = &settings;
+  decoder.inspect_stack =
+      with_magic ? SelectInspectStack<CoroControlBlockWithMagic>(
+                       known_pull_layout)
+                 : SelectInspectStack<CoroControlBlock>(known_pull_layout);
+
+  if (settings.context_implementation == ContextImplementation::kFcontext) {
+    decoder.read_registers = &TryGetRegistersFromFcontext;
+    return decoder;
+  }
+
+  decoder.read_registers = &TryGetRegistersFromUcontext;
+  auto record_type = target.FindFirstType(kFiberActivationRecordTypeName);
+  if (record_type.IsValid()) {
+    decoder.ucontext_offset = GetFieldOffset(record_type, "uctx")
+                                  .value_or(kDefaultUcontextOffset);
+  }
+  return decoder;
+}
+
+// Calls on_pc for the coroutine registers rip and then for every return
+// address found by following saved frame pointers, without leaving the
+// coroutine stack.
+template <typename OnPc>
+void WalkFramePointers(lldb::SBProcess& process, const CoroInfo& coro,
+                       OnPc on_pc) {
+  constexpr std::size_t kMaxDepth = 4096;
+
+  // the frame registers point into
+  on_pc(static_cast<std::uintptr_t>(coro.registers.rip));
+  std::size_t depth = 1;
+  auto frame_pointer = static_cast<std::uintptr_t>(coro.registers.rbp);
+  while (depth < kMaxDepth && frame_pointer >= coro.region.begin &&
+         frame_pointer + 2 * sizeof(std::uintptr_t) <= coro.region.end) {
+    // [rbp] is the caller's rbp, [rbp + 8] is the return address
+    std::uintptr_t frame_record[2]{};
+    lldb::SBError error{};
+    process.ReadMemory(frame_pointer, frame_record, sizeof(frame_record),
+                       error);
+    if (!error.Success() || frame_record[1] == 0) {
+      break;
+    }
+
+    on_pc(frame_record[1]);
+    ++depth;
+    // stack grows down, so callers' frames are always above
+    if (frame_record[0] <= frame_pointer) {
+      break;
+    }
+    frame_pointer = frame_record[0];
+  }
+}
+
+}  // namespace
+
+const CoroDecoder* GetDecoder(lldb::SBProcess& process,
+                              lldb::SBCommandReturnObject& result) {
+  // We already validated that settings aren't null
+  const auto& settings = *GetSettings();
+
+  struct CachedDecoder final {
+    std::uint32_t process_id{};
+    const LLC2Settings* settings{};
+    bool with_magic{};
+    ContextImplementation context_implementation{};
+    std::optional<CoroDecoder> decoder;
+    // why there is no decoder
+    std::string error;
+  };
+  static std::optional<CachedDecoder> cached;
+
+  const auto process_id = process.GetUniqueID();
+  if (!cached.has_value() || cached->process_id != process_id ||
+      cached->settings != &settings ||
+      cached->with_magic != settings.with_magic ||
+      cached->context_implementation != settings.context_implementation) {
+    std::string error;
+    auto decoder = DetectDecoder(process, result, settings, error);
+    cached.emplace(CachedDecoder{process_id, &settings, settings.with_magic,
+                                 settings.context_implementation,
+                                 std::move(decoder), std::move(error)});
+  }
+
+  if (!cached->decoder.has_value()) {
+    result.Printf("%s\n", cached->error.data());
+    return nullptr;
+  }
+  return &*cached->decoder;
+}
+
+std::size_t CoroInfo::GetStackUsage() const {
+  const auto rsp = static_cast<std::uintptr_t>(registers.rsp);
+  if (rsp < region.begin || rsp > region.end) {
+    return 0;
+  }
+  return region.end - rsp;
+}
+
+std::vector<RegionInfo> GetProcessMemoryRegions(
+    lldb::SBProcess& process, lldb::SBCommandReturnObject& result) {
+  auto lldb_regions = process.GetMemoryRegions();
+
+  // A core or a process with a huge heap may have millions of regions. If
+  // interrupted, the regions read so far are returned, and callers stop on
+  // the same flag before doing anything with them.
+  auto interpreter =
+      process.GetTarget().GetDebugger().GetCommandInterpreter();
+  std::vector<RegionInfo> regions(lldb_regions.GetSize());
+  for (std::uint32_t i = 0; i < lldb_regions.GetSize(); ++i) {
+    if (interpreter.WasInterrupted()) {
+      regions.resize(i);
+      break;
+    }
+
+    lldb::SBMemoryRegionInfo region_info{};
+    if (!lldb_regions.GetMemoryRegionAtIndex(i, region_info)) {
+      result.Printf("Failed to get memory region info at index %u\n", i);
+      continue;
+    }
+    regions[i].begin = region_info.GetRegionBase();
+    regions[i].end = region_info.GetRegionEnd();
+  }
+
+  std::sort(
+      regions.begin(), regions.end(),
+      [](const auto& lhs, const auto& rhs) { return lhs.begin < rhs.begin; });
+  return regions;
+}
+
+std::vector<RegionInfo> GetCandidateStacks(
+    lldb::SBProcess& process, lldb::SBCommandReturnObject& result) {
+  // We already validated that settings aren't null
+  const auto& settings = *GetSettings();
+
+  auto regions = GetProcessMemoryRegions(process, result);
+  regions.erase(std::remove_if(regions.begin(), regions.end(),
+                               [&settings](const RegionInfo& region) {
+                                 return region.end - region.begin !=
+                                        settings.GetRealStackSize();
+                               }),
+                regions.end());
+  return regions;
+}
+
+const RegionInfo* FindRegion(const std::vector<RegionInfo>& regions,
+                             std::uintptr_t address) {
+  auto it = std::upper_bound(
+      regions.begin(), regions.end(), address,
+      [](std::uintptr_t value, const auto& region) {
+        return value < region.begin;
+      });
+  if (it == regions.begin()) {
+    return nullptr;
+  }
+  --it;
+  return address < it->end ? &*it : nullptr;
+}
+
+const RegionInfo* FindThreadStack(lldb::SBThread& thread,
+                                  const std::vector<RegionInfo>& stacks) {
+  const auto sp = thread.GetFrameAtIndex(0).GetSP();
+  return FindRegion(stacks, static_cast<std::uintptr_t>(sp));
+}
+
+std::optional<StackInfo> TryInspectStack(lldb::SBProcess& process,
+                                         lldb::SBCommandReturnObject& result,
+                                         const CoroDecoder& decoder,
+                                         const RegionInfo& region_info) {
+  return decoder.inspect_stack(process, result, region_info,
+                               *decoder.settings);
+}
+
+std::optional<UnwindRegisters> TryReadRegisters(
+    lldb::SBProcess& process, lldb::SBCommandReturnObject& result,
+    const CoroDecoder& decoder, const StackInfo& stack) {
+  if (!stack.IsSuspended()) {
+    return std::nullopt;
+  }
+  return decoder.read_registers(process, result, stack.fiber,
+                                decoder.ucontext_offset);
+}
+
+const char* GetCoroutineStatus(const StackInfo& stack) {
+  if ((static_cast<unsigned int>(stack.state) &
+       static_cast<unsigned int>(state_t::complete)) != 0) {
+    return "complete";
+  }
+  return stack.IsSuspended() ? "suspended" : "running";
+}
+
+std::optional<CoroInfo> TryDiscoverCoroutine(
+    lldb::SBProcess& process, lldb::SBCommandReturnObject& result,
+    const CoroDecoder& decoder, const RegionInfo& region_info) {
+  const auto stack = TryInspectStack(process, result, decoder, region_info);
+  if (!stack.has_value() || !stack->IsSuspended()) {
+    return std::nullopt;
+  }
+
+  const auto registers = TryReadRegisters(process, result, decoder, *stack);
+  if (!registers.has_value()) {
+    return std::nullopt;
+  }
+
+  return CoroInfo{region_info, *registers, stack->task_context};
+}
+
+std::size_t GetFramePointerDepth(lldb::SBProcess& process,
+                                 const CoroInfo& coro) {
+  std::size_t depth = 0;
+  WalkFramePointers(process, coro, [&depth](std::uintptr_t) { ++depth; });
+  return depth;
+}
+
+std::vector<std::uintptr_t> GetFramePointerPcs(lldb::SBProcess& process,
+                                               const CoroInfo& coro) {
+  std::vector<std::uintptr_t> pcs;
+  WalkFramePointers(process, coro,
+                    [&pcs](std::uintptr_t pc) { pcs.push_back(pc); });
+  return pcs;
+}
+
+}  // namespace llc2
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <lldb/API/SBCommandReturnObject.h>
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBThread.h>
+
+#if __linux__
+#include <sys/ucontext.h>
+#endif
+
+namespace llc2 {
+
+struct RegionInfo final {
+  std::uintptr_t begin{};
+  std::uintptr_t end{};
+};
+
+enum class state_t : unsigned int {
+  none = 0,
+  complete = 1 << 1,
+  unwind = 1 << 2,
+  destroy = 1 << 3
+};
+
+// What control blocks on top of a coroutine stack tell, which is available
+// for running coroutines as well as for suspended ones.
+struct StackInfo final {
+  RegionInfo region{};
+  // boost state of push_coroutine
+  state_t state{state_t::none};
+  // Value held by pull_coroutine<TaskContext*>, that is the TaskContext
+  // the coroutine was last resumed with. Zero if coroutine never ran.
+  std::uintptr_t task_context{};
+  // Saved coroutine context, it's null while the coroutine runs.
+  void* fiber{};
+
+  // this doesn't directly relate to neither stack bottom nor stack top
+  std::uintptr_t GetStackAddress() const { return region.begin; }
+
+  bool IsSuspended() const { return fiber != nullptr; }
+};
+
+// We only need 3 registers to unwind: rsp, rbp and rip.
+// This is all x86_64 ofc.
+struct UnwindRegisters final {
+  std::int64_t rsp{};  // stack pointer
+  std::int64_t rbp{};  // frame pointer
+  std::int64_t rip{};  // instruction pointer
+
+  UnwindRegisters(std::int64_t rsp, std::int64_t rbp, std::int64_t rip)
+      : rsp{rsp}, rbp{rbp}, rip{rip} {}
+
+#if __linux__
+  UnwindRegisters(const ucontext_t& ucontext)
+      : rsp{ucontext.uc_mcontext.gregs[REG_RSP]},
+        rbp{ucontext.uc_mcontext.gregs[REG_RBP]},
+        rip{ucontext.uc_mcontext.gregs[REG_RIP]} {}
+#endif
+};
+
+// Everything we know about a suspended coroutine without asking LLDB to
+// unwind it: this is cheap to get for every stack in the process.
+struct CoroInfo final {
+  RegionInfo region{};
+  UnwindRegisters registers;
+  // Value held by pull_coroutine<TaskContext*>, that is the TaskContext
+  // the coroutine was last resumed with. Zero if coroutine never ran.
+  std::uintptr_t task_context{};
+
+  // this doesn't directly relate to neither stack bottom nor stack top
+  std::uintptr_t GetStackAddress() const { return region.begin; }
+
+  // Bytes between the top of the stack and the saved stack pointer.
+  std::size_t GetStackUsage() const;
+};
+
+std::vector<RegionInfo> GetProcessMemoryRegions(
+    lldb::SBProcess& process, lldb::SBCommandReturnObject& result);
+
+// Returns regions which look like coroutine stacks, that is the ones of
+// configured stack size, sorted by address.
+std::vector<RegionInfo> GetCandidateStacks(lldb::SBProcess& process,
+                                           lldb::SBCommandReturnObject& result);
+
+// Returns the region containing address, regions must be sorted.
+const RegionInfo* FindRegion(const std::vector<RegionInfo>& regions,
+                             std::uintptr_t address);
+
+// Returns the coroutine stack the thread is running on, if any: a thread
+// running a coroutine has its stack pointer inside the coroutine stack.
+const RegionInfo* FindThreadStack(lldb::SBThread& thread,
+                                  const std::vector<RegionInfo>& stacks);
+
+// Knows boost.Coroutine2 layouts of a particular process.
+struct CoroDecoder;
+
+// Picks decoders for the process from its debug info and settings, which is
+// meant to be done once per command, before going over the stacks. Detection
+// itself is cached per process and settings. Returns null if the process
+// has a layout we don't know, result says which.
+const CoroDecoder* GetDecoder(lldb::SBProcess& process,
+                              lldb::SBCommandReturnObject& result);
+
+// Reads boost control blocks on top of the stack, returns nullopt if
+// region doesn't contain a coroutine.
+std::optional<StackInfo> TryInspectStack(lldb::SBProcess& process,
+                                         lldb::SBCommandReturnObject& result,
+                                         const CoroDecoder& decoder,
+                                         const RegionInfo& region_info);
+
+// Saved registers of a suspended coroutine, nullopt for a running one.
+std::optional<UnwindRegisters> TryReadRegisters(
+    lldb::SBProcess& process, lldb::SBCommandReturnObject& result,
+    const CoroDecoder& decoder, const StackInfo& stack);
+
+// "complete", "suspended" or "running", from boost point of view.
+const char* GetCoroutineStatus(const StackInfo& stack);
+
+// Same as TryInspectStack, but only succeeds for suspended coroutines and
+// also reads their saved registers.
+std::optional<CoroInfo> TryDiscoverCoroutine(
+    lldb::SBProcess& process, lldb::SBCommandReturnObject& result,
+    const CoroDecoder& decoder, const RegionInfo& region_info);
+
+// Number of frames reachable by following saved frame pointers from the
+// coroutine registers, without leaving the coroutine stack. Only meaningful
+// for code built with frame pointers, but is way cheaper than a real unwind.
+std::size_t GetFramePointerDepth(lldb::SBProcess& process,
+                                 const CoroInfo& coro);
+
+// Same walk as GetFramePointerDepth, returns coroutine rip followed by the
+// return addresses of its frames.
+std::vector<std::uintptr_t> GetFramePointerPcs(lldb::SBProcess& process,
+                                               const CoroInfo& coro);
+
+}  // namespace llc2
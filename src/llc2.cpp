@@ -1,5 +1,13 @@
 #include "llc2_bt_cmd.hpp"
+#include "llc2_coros_cmd.hpp"
+#include "llc2_diff_cmd.hpp"
+#include "llc2_frames_cmd.hpp"
 #include "llc2_init_cmd.hpp"
+#include "llc2_save_cmd.hpp"
+#include "llc2_stacks_cmd.hpp"
+#include "llc2_tasks_cmd.hpp"
+#include "llc2_threads_cmd.hpp"
+#include "llc2_waits_cmd.hpp"
 
 namespace lldb {
 bool PluginInitialize(lldb::SBDebugger debugger) {
@@ -20,10 +28,83 @@ bool PluginInitialize(lldb::SBDebugger debugger) {
       "bt", new llc2::BacktraceCmd{},
       "Print backtrace of all currently sleeping coroutines\n"
       "-f              print full backtrace (with locals and arguments)\n"
+      "--fast          unwind by frame pointers and symbolize all PCs at "
+      "once, way faster for many coroutines, needs frame pointers\n"
       "-s              only backtrace coroutine with this stack address "
       "(in hexadecimal base). stack address can be found in output of "
-      "prior 'llc2 bt'\n",
-      "llc2 bt -s 0x7ffff7f07000 -f\n");
+      "prior 'llc2 bt'\n"
+      "--sort          order coroutines by (address|depth|usage|span|age)\n"
+      "--offset        skip this many coroutines\n"
+      "--limit         only backtrace this many coroutines\n"
+      "--depth         with -f, how deep to expand nested members (3)\n"
+      "--max-children  with -f, how many children of a value to print (32)\n"
+      "--max-bytes     with -f, variables output limit per coroutine "
+      "(65536)\n",
+      "llc2 bt -s 0x7ffff7f07000 -f\n"
+      "llc2 bt --sort usage --limit 10\n"
+      "llc2 bt --fast\n");
+
+  llc2.AddCommand(
+      "waits", new llc2::WaitsCmd{},
+      "Print synchronization primitives sleeping coroutines wait on, "
+      "the most contended first, and cycles of coroutines waiting on "
+      "each other\n"
+      "-n              how many primitives to print (10)\n",
+      "llc2 waits -n 5\n");
+
+  llc2.AddCommand(
+      "tasks", new llc2::TasksCmd{},
+      "Print counts of coroutines per task processor, coroutine state and "
+      "task state, OS threads running tasks right now and a histogram of "
+      "how long tasks have been sleeping. Nothing is unwound\n",
+      "llc2 tasks\n");
+
+  llc2.AddCommand(
+      "coros", new llc2::CorosCmd{},
+      "Print all coroutines as a JSON document, for scripts. Discovery "
+      "results are reused until the process resumes, frames are not "
+      "resolved, see 'llc2 frames'\n"
+      "--status          only (complete|suspended|running) coroutines\n"
+      "--task-processor  only coroutines of this task processor\n"
+      "--span            only coroutines with this in their span name\n"
+      "--offset          skip this many matching coroutines\n"
+      "--limit           only print this many matching coroutines\n",
+      "llc2 coros --status suspended --limit 100\n");
+
+  llc2.AddCommand(
+      "frames", new llc2::FramesCmd{},
+      "Print frames of suspended coroutines with these stack addresses (in "
+      "hexadecimal base) as a JSON document, for scripts\n",
+      "llc2 frames 0x7ffff7f07000 0x7ffff7e06000\n");
+
+  llc2.AddCommand(
+      "save", new llc2::SaveCmd{},
+      "Save stacks and spans of sleeping coroutines to a file, for a later "
+      "'llc2 diff'. Coroutines are unwound by frame pointers\n",
+      "llc2 save before.llc2\n");
+
+  llc2.AddCommand(
+      "diff", new llc2::DiffCmd{},
+      "Compare sleeping coroutines of two snapshots made by 'llc2 save', or "
+      "of a snapshot and the current process: which stacks gained or lost "
+      "coroutines, and which tasks are still in the same sleep\n"
+      "-n              how many groups and coroutines to print (20)\n",
+      "llc2 diff before.llc2 after.llc2\n"
+      "llc2 diff before.llc2\n");
+
+  llc2.AddCommand(
+      "stacks", new llc2::StacksCmd{},
+      "Print coroutine stacks counts per task processor, pooled and in use\n"
+      "--rss           also print how much of them is resident in memory, "
+      "from /proc/<pid>/pagemap or from pages present in the core\n"
+      "--per-stack     with --rss, also print every stack\n",
+      "llc2 stacks --rss\n");
+
+  llc2.AddCommand(
+      "threads", new llc2::ThreadsCmd{},
+      "Print which coroutine every OS thread is running, with its task, span "
+      "and frames of the coroutine stack\n",
+      "llc2 threads\n");
 
   return true;
 }
@@ -1,18 +1,20 @@
 #include "llc2_bt_cmd.hpp"
 
+#include "discovery.hpp"
+#include "registers_guard.hpp"
 #include "settings.hpp"
+#include "symbolizer.hpp"
+#include "userver.hpp"
+#include "utils.hpp"
+#include "variable_dumper.hpp"
 
-#include <sys/ucontext.h>
-#include <chrono>
+#include <algorithm>
 #include <cstring>
-#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
 
-#include <lldb/API/SBMemoryRegionInfo.h>
-#include <lldb/API/SBMemoryRegionInfoList.h>
 #include <lldb/API/SBProcess.h>
 #include <lldb/API/SBStream.h>
 #include <lldb/API/SBTarget.h>
@@ -22,367 +24,36 @@ namespace llc2 {
 
 namespace {
 
-std::uint32_t terminal_width;
-
-constexpr std::string_view kUserverSleepMark =
-    "engine::impl::TaskContext::Sleep(";
-constexpr std::string_view kUserverWrappedCallImplMark =
-    "utils::impl::WrappedCallImpl<";
-constexpr std::string_view kTaskContextPointerTypeMark =
-    "engine::impl::TaskContext *";
-
-constexpr std::string_view kLotsOfDashes =
-    "--------------------------------------------------------------------------"
-    "--------------------------------------------------------------------------"
-    "---------------------------------------------------";
-
-constexpr std::string_view GetDashesSw(std::size_t size) {
-  return kLotsOfDashes.substr(0, std::min(kLotsOfDashes.size(), size));
-}
-
-struct RegionInfo final {
-  std::uintptr_t begin{};
-  std::uintptr_t end{};
-};
-
-std::vector<RegionInfo> GetProcessMemoryRegions(
-    lldb::SBProcess& process, lldb::SBCommandReturnObject& result) {
-  auto lldb_regions = process.GetMemoryRegions();
-
-  std::vector<RegionInfo> regions(lldb_regions.GetSize());
-  for (std::uint32_t i = 0; i < lldb_regions.GetSize(); ++i) {
-    lldb::SBMemoryRegionInfo region_info{};
-    if (!lldb_regions.GetMemoryRegionAtIndex(i, region_info)) {
-      result.Printf("Failed to get memory region info at index %u\n", i);
-      continue;
-    }
-    regions[i].begin = region_info.GetRegionBase();
-    regions[i].end = region_info.GetRegionEnd();
-  }
-
-  std::sort(
-      regions.begin(), regions.end(),
-      [](const auto& lhs, const auto& rhs) { return lhs.begin < rhs.begin; });
-  return regions;
-}
-
-std::chrono::steady_clock::time_point Now() {
-  return std::chrono::steady_clock::now();
-}
-
-void PrintDuration(lldb::SBCommandReturnObject& result, const std::string& name,
-                   std::chrono::steady_clock::time_point start,
-                   std::chrono::steady_clock::time_point finish) {
-  result.Printf(
-      "%s duration: %lu"
-      "ms\n",
-      name.data(),
-      std::chrono::duration_cast<std::chrono::milliseconds>(finish - start)
-          .count());
-}
-
-struct ScopeTimer final {
-  std::string name;
-  std::chrono::steady_clock::time_point start;
-  lldb::SBCommandReturnObject& result;
-
-  ScopeTimer(lldb::SBCommandReturnObject& result, std::string name)
-      : name{std::move(name)}, start{Now()}, result{result} {}
-
-  ~ScopeTimer() {
-    if (armed_) {
-      PrintDuration(result, name, start, Now());
-    }
-  }
-
-  void Disarm() { armed_ = false; }
-
- private:
-  bool armed_{true};
-};
-
-enum class state_t : unsigned int {
-  none = 0,
-  complete = 1 << 1,
-  unwind = 1 << 2,
-  destroy = 1 << 3
-};
-
-// This struct mimics that of boost.Coroutine2
-struct CoroControlBlockWithMagic final {
-  std::size_t magic{0};
-  void* fiber{};
-  void* other{};  // this is pull_coroutine
-  state_t state{};
-  void* except{};  // this is std::exception_ptr
-
-  static constexpr std::size_t kMagic = 0x12345678;
-};
-
-// This struct mimics that of boost.Coroutine2
-struct CoroControlBlock final {
-  void* fiber{};
-  void* other{};  // this is pull_coroutine
-  state_t state{};
-  void* except{};  // this is std::exception_ptr
-};
-
-void* GetFiberPointer(lldb::SBProcess& process,
-                      lldb::SBCommandReturnObject& result,
-                      const RegionInfo& region_info, void* sp,
-                      const LLC2Settings& settings) {
-  if (settings.with_magic) {
-    const auto remaining_size =
-        GetSettings()->GetMmapSize() -
-        (reinterpret_cast<char*>(region_info.end) - static_cast<char*>(sp));
-    const auto expected_magic = CoroControlBlockWithMagic::kMagic ^
-                                reinterpret_cast<std::uintptr_t>(sp) ^
-                                remaining_size;
-
-    CoroControlBlockWithMagic control_block{};
-    lldb::SBError error{};
-    process.ReadMemory(reinterpret_cast<std::uintptr_t>(sp), &control_block,
-                       sizeof(CoroControlBlockWithMagic), error);
-    if (!error.Success()) {
-      result.Printf(
-          "Failed to read Coro::control_block from process memory: %s\n",
-          error.GetCString());
-      return nullptr;
-    }
-
-    if (control_block.magic != expected_magic) {
-      result.Printf("Magic doesn't match: expected %lu, got %lu\n",
-                    expected_magic, control_block.magic);
-      return nullptr;
-    }
-
-    return control_block.fiber;
-  } else {
-    CoroControlBlock control_block{};
-    lldb::SBError error{};
-    process.ReadMemory(reinterpret_cast<std::uintptr_t>(sp), &control_block,
-                       sizeof(CoroControlBlock), error);
-    if (!error.Success()) {
-      result.Printf(
-          "Failed to read Coro::control_block from process memory: %s\n",
-          error.GetCString());
-      return nullptr;
-    }
-
-    return control_block.fiber;
-  }
-}
-
-// We only need 3 registers to unwind: rsp, rbp and rip.
-// This is all x86_64 ofc.
-struct UnwindRegisters final {
-  std::int64_t rsp{};  // stack pointer
-  std::int64_t rbp{};  // frame pointer
-  std::int64_t rip{};  // instruction pointer
-
-  UnwindRegisters(std::int64_t rsp, std::int64_t rbp, std::int64_t rip)
-      : rsp{rsp}, rbp{rbp}, rip{rip} {}
-
-#if __linux__
-  UnwindRegisters(const ucontext_t& ucontext)
-      : rsp{ucontext.uc_mcontext.gregs[REG_RSP]},
-        rbp{ucontext.uc_mcontext.gregs[REG_RBP]},
-        rip{ucontext.uc_mcontext.gregs[REG_RIP]} {}
-#endif
-};
-
-std::unique_ptr<UnwindRegisters> TryGetRegistersFromUcontext(
-    lldb::SBProcess& process, lldb::SBCommandReturnObject& result,
-    void* fiber_ptr) {
-  lldb::SBError error{};
-  ucontext_t context{};
-  // fiber_ptr points to fiber_activation_record, which has ucontext_t as the
-  // first field. We hope that compiler doesn't reorder fields in the struct.
-  // TODO : what's the deal with +8 here?
-  process.ReadMemory(reinterpret_cast<std::uintptr_t>(fiber_ptr) + 8, &context,
-                     sizeof(ucontext_t), error);
-  if (!error.Success()) {
-    result.Printf("Failed to read ucontext from process memory: %s\n",
-                  error.GetCString());
-    return nullptr;
-  }
-
-#if __APPLE__
-  _STRUCT_MCONTEXT data{};
-  process.ReadMemory(reinterpret_cast<std::uintptr_t>(context.uc_mcontext),
-                     &data, sizeof(_STRUCT_MCONTEXT), error);
-  if (!error.Success()) {
-    result.Printf("Failed to read ucontext from process memory: %s\n",
-                  error.GetCString());
-    return nullptr;
-  }
-
-  return std::make_unique<UnwindRegisters>(data.__ss.__rsp, data.__ss.__rbp,
-                                           data.__ss.__rip);
-#elif __linux__
-  return std::make_unique<UnwindRegisters>(context);
-#endif
-}
-
-// clang-format off
-/****************************************************************************************
- *                                                                                      *
- *  ----------------------------------------------------------------------------------  *
- *  |    0    |    1    |    2    |    3    |    4     |    5    |    6    |    7    |  *
- *  ----------------------------------------------------------------------------------  *
- *  |   0x0   |   0x4   |   0x8   |   0xc   |   0x10   |   0x14  |   0x18  |   0x1c  |  *
- *  ----------------------------------------------------------------------------------  *
- *  | fc_mxcsr|fc_x87_cw|        R12        |         R13        |        R14        |  *
- *  ----------------------------------------------------------------------------------  *
- *  ----------------------------------------------------------------------------------  *
- *  |    8    |    9    |   10    |   11    |    12    |    13   |    14   |    15   |  *
- *  ----------------------------------------------------------------------------------  *
- *  |   0x20  |   0x24  |   0x28  |  0x2c   |   0x30   |   0x34  |   0x38  |   0x3c  |  *
- *  ----------------------------------------------------------------------------------  *
- *  |        R15        |        RBX        |         RBP        |        RIP        |  *
- *  ----------------------------------------------------------------------------------  *
- *                                                                                      *
- ****************************************************************************************/
-// clang-format on
-std::unique_ptr<UnwindRegisters> TryGetRegistersFromFcontext(
-    lldb::SBProcess& process, lldb::SBCommandReturnObject& result,
-    void* fiber_ptr) {
-  constexpr std::size_t kContextDataSize = 0x40;
-
-  char context_data[kContextDataSize];
-  lldb::SBError error{};
-  // so fiber_ptr is a detail::fcontext_t, which in turn is just a void*.
-  process.ReadMemory(reinterpret_cast<std::uintptr_t>(fiber_ptr), &context_data,
-                     kContextDataSize, error);
-  if (!error.Success()) {
-    result.Printf("Failed to read fcontext from process memory: %s\n",
-                  error.GetCString());
-    return nullptr;
-  }
-
-  const auto read_with_offset = [&context_data](std::size_t offset) {
-    return *reinterpret_cast<std::int64_t*>(&context_data[offset]);
-  };
-
-  // with fcontext fiber_ptr is a pointer to context data,
-  // detail::jump_fcontext populate registers from it and sets rsp to it + 0x40
-  const auto rsp = reinterpret_cast<std::int64_t>(fiber_ptr) + kContextDataSize;
-  const auto rbp = read_with_offset(0x30);
-  const auto rip = read_with_offset(0x38);
-
-  return std::make_unique<UnwindRegisters>(rsp, rbp, rip);
-}
-
-std::unique_ptr<UnwindRegisters> TryFindCoroRegisters(
-    lldb::SBProcess& process, lldb::SBCommandReturnObject& result,
-    const RegionInfo& region_info) {
-  // We already validated that settings aren't null
-  const auto& settings = *GetSettings();
-
-  constexpr std::size_t func_alignment = 64;  // alignof( ControlBlock);
-  const std::size_t func_size = settings.with_magic
-                                    ? sizeof(CoroControlBlockWithMagic)
-                                    : sizeof(CoroControlBlock);
-
-  // reserve space on stack
-  void* sp =
-      reinterpret_cast<char*>(region_info.end) - func_size - func_alignment;
-  // align sp pointer
-  std::size_t space = func_size + func_alignment;
-  sp = std::align(func_alignment, func_size, sp, space);
-  // sp is where coroutine::control_block is allocated on stack
-
-  void* fiber_ptr = GetFiberPointer(process, result, region_info, sp, settings);
-  if (fiber_ptr == nullptr) {
-    return nullptr;
-  }
-
-  if (settings.context_implementation == ContextImplementation::kUcontext) {
-    return TryGetRegistersFromUcontext(process, result, fiber_ptr);
-  } else {
-    return TryGetRegistersFromFcontext(process, result, fiber_ptr);
-  }
-}
-
-std::string GetFullWidth(std::string_view what, bool center) {
-  if (what.size() + 2 > terminal_width) {
-    return std::string{what};
-  }
-
-  const auto num_dashes = (terminal_width - (what.size() + 2)) / 2;
-  std::string result;
-  result.reserve(terminal_width);
-
-  if (center) {
-    result.append(GetDashesSw(num_dashes))
-        .append(" ")
-        .append(what)
-        .append(" ")
-        .append(GetDashesSw(num_dashes));
-  } else {
-    result.append(what).append(" ").append(GetDashesSw(num_dashes * 2));
-  }
-
-  return result;
-}
-
-bool EndsWith(std::string_view source, std::string_view what) {
-  const auto pos = source.find(what);
-  return pos != std::string_view::npos && pos + what.size() == source.size();
-}
-
-// https://bugs.llvm.org/show_bug.cgi?id=24202
-
-// Clang is not emitting debug information for std::string because it was told
-// that libstdc++ provides it. This is a debug size optimization that GCC
-// apparently doesn't perform.
-//
-// So we read strings by hand to not depend on libstdc++ debug info presence.
-std::optional<std::string> ReadStdString(lldb::SBProcess process,
-                                         std::size_t address,
-                                         lldb::SBCommandReturnObject& result) {
-  // let's hope for the best
-  constexpr std::size_t kBufferSize = sizeof(std::string);
-  constexpr std::size_t kMaxLen = 100;
-
-  if (address == 0) {
-    return std::nullopt;
-  }
-
-  char buffer[kBufferSize]{};
-  lldb::SBError error{};
-  process.ReadMemory(address, buffer, kBufferSize, error);
-  if (!error.Success()) {
-    result.Printf("Failed to read std::string from process memory: %s\n",
-                  error.GetCString());
-    return std::nullopt;
-  }
-
-  const auto* fake_str_ptr = reinterpret_cast<std::string*>(buffer);
-
-  const auto* data = fake_str_ptr->data();
-  const auto size = fake_str_ptr->size();
-  if (size > kMaxLen) {
-    return std::nullopt;
+void PrintCoroutineHeader(std::uintptr_t stack_address,
+                          std::optional<std::int64_t> sleep_age,
+                          const std::optional<SpanInfo>& span_info,
+                          lldb::SBCommandReturnObject& result) {
+  const auto found_coroutine_title =
+      GetFullWidth("FOUND SLEEPING COROUTINE", true);
+  result.AppendMessage(found_coroutine_title.data());
+  auto printed = result.Printf("coro stack address: %p",
+                               reinterpret_cast<void*>(stack_address));
+  if (sleep_age.has_value()) {
+    printed += result.Printf(" | sleeping for: %s",
+                             FormatDuration(*sleep_age).data());
   }
+  result.Printf("\n%s\n", std::string{GetDashesSw(printed)}.data());
 
-  std::string result_string{};
-  result_string.resize(size);
-
-  process.ReadMemory(reinterpret_cast<std::uintptr_t>(data),
-                     result_string.data(), size, error);
-  if (!error.Success()) {
-    result.Printf("Failed to read std::string from process memory: %s\n",
-                  error.GetCString());
-    return std::nullopt;
+  if (span_info.has_value()) {
+    printed =
+        result.Printf("Current span (name, span_id, trace_id): %s | %s | %s",
+                      span_info->name.data(), span_info->span_id.data(),
+                      span_info->trace_id.data());
+    result.Printf("\n%s\n", std::string{GetDashesSw(printed)}.data());
   }
-
-  return {std::move(result_string)};
 }
 
+// Variables are only dumped if variable_dumper isn't null.
 bool BacktraceCoroutine(std::uintptr_t stack_address,
+                        std::optional<std::int64_t> sleep_age,
                         lldb::SBThread& current_thread,
-                        lldb::SBCommandReturnObject& result, bool full) {
+                        lldb::SBCommandReturnObject& result,
+                        VariableDumper* variable_dumper) {
   const auto num_frames = current_thread.GetNumFrames();
 
   bool has_sleep = false;
@@ -390,11 +61,6 @@ bool BacktraceCoroutine(std::uintptr_t stack_address,
 
   std::vector<lldb::SBStream> frame_descriptions(num_frames);
 
-  struct SpanInfo final {
-    std::string name;
-    std::string span_id;
-    std::string trace_id;
-  };
   std::optional<SpanInfo> span_info{};
 
   for (int i = 0; i < num_frames; ++i) {
@@ -422,35 +88,8 @@ bool BacktraceCoroutine(std::uintptr_t stack_address,
       if (display_type_name != nullptr &&
           EndsWith(display_type_name, kTaskContextPointerTypeMark) &&
           !span_info.has_value()) {
-        auto task_context = maybe_context_ptr.Dereference();
-        auto span_ptr =
-            task_context.GetChildMemberWithName("current_span_within_sleep_");
-
-        if (span_ptr.GetValueAsUnsigned() != 0) {
-          auto span_impl = span_ptr.Dereference()
-                               .GetChildMemberWithName("pimpl_")
-                               .Dereference();
-
-          auto lldb_name = span_impl.GetChildMemberWithName("name_");
-          auto lldb_span_id = span_impl.GetChildMemberWithName("span_id_");
-          auto lldb_trace_id = span_impl.GetChildMemberWithName("trace_id_");
-
-          const auto name_opt =
-              ReadStdString(current_thread.GetProcess(),
-                            lldb_name.AddressOf().GetValueAsUnsigned(), result);
-          const auto span_id_opt = ReadStdString(
-              current_thread.GetProcess(),
-              lldb_span_id.AddressOf().GetValueAsUnsigned(), result);
-          const auto trace_id_opt = ReadStdString(
-              current_thread.GetProcess(),
-              lldb_trace_id.AddressOf().GetValueAsUnsigned(), result);
-
-          const std::string empty_str{"(none)"};
-
-          span_info.emplace(SpanInfo{name_opt.value_or(empty_str),
-                                     span_id_opt.value_or(empty_str),
-                                     trace_id_opt.value_or(empty_str)});
-        }
+        span_info = ReadSpanInfo(maybe_context_ptr.Dereference(),
+                                 current_thread.GetProcess(), result);
       }
     }
 
@@ -462,8 +101,13 @@ bool BacktraceCoroutine(std::uintptr_t stack_address,
   }
   if (!has_sleep) return false;
 
-  const auto dump_variables = [](lldb::SBFrame& frame, lldb::SBStream& stream,
-                                 bool arguments, bool locals) {
+  const auto dump_variables = [variable_dumper](lldb::SBFrame& frame,
+                                                lldb::SBStream& stream,
+                                                bool arguments, bool locals) {
+    // the limit is only reported once, no need for empty titles after it
+    if (variable_dumper->IsBudgetExhausted()) {
+      return;
+    }
     auto frame_variables = frame.GetVariables(
         arguments, locals, false /* statics */, true /* in_scope_only */);
     if (frame_variables.GetSize() > 0) {
@@ -476,31 +120,24 @@ bool BacktraceCoroutine(std::uintptr_t stack_address,
       }
     }
     for (std::uint32_t j = 0; j < frame_variables.GetSize(); ++j) {
-      auto variable = frame_variables.GetValueAtIndex(j);
-      variable.GetDescription(stream);
+      if (!variable_dumper->Dump(frame_variables.GetValueAtIndex(j),
+                                 stream)) {
+        break;
+      }
     }
   };
 
-  const auto found_coroutine_title =
-      GetFullWidth("FOUND SLEEPING COROUTINE", true);
-  result.AppendMessage(found_coroutine_title.data());
-  auto printed = result.Printf("coro stack address: %p",
-                               reinterpret_cast<void*>(stack_address));
-  result.Printf("\n%s\n", std::string{GetDashesSw(printed)}.data());
+  PrintCoroutineHeader(stack_address, sleep_age, span_info, result);
 
-  if (span_info.has_value()) {
-    printed =
-        result.Printf("Current span (name, span_id, trace_id): %s | %s | %s",
-                      span_info->name.data(), span_info->span_id.data(),
-                      span_info->trace_id.data());
-    result.Printf("\n%s\n", std::string{GetDashesSw(printed)}.data());
+  if (variable_dumper != nullptr) {
+    variable_dumper->StartCoroutine(stack_address);
   }
 
   lldb::SBStream result_stream{};
   for (int i = 0; i < wrapped_call_frame; ++i) {
     auto frame = current_thread.GetFrameAtIndex(i);
     result_stream.Print(frame_descriptions[i].GetData());
-    if (full) {
+    if (variable_dumper != nullptr) {
       dump_variables(frame, result_stream, true, false);
       dump_variables(frame, result_stream, false, true);
     }
@@ -510,11 +147,49 @@ bool BacktraceCoroutine(std::uintptr_t stack_address,
   return true;
 }
 
+enum class SortBy { kAddress, kDepth, kUsage, kSpan, kAge };
+
 struct BtSettings final {
   bool full{false};
+  // unwind with frame pointers and symbolize in bulk, see FastBacktrace
+  bool fast{false};
   std::optional<std::uintptr_t> stack_address;
+  SortBy sort_by{SortBy::kAddress};
+  std::size_t offset{0};
+  std::optional<std::size_t> limit;
+  VariableLimits variable_limits{};
+  bool invalid{false};
 };
 
+std::optional<SortBy> ParseSortBy(const char* s) {
+  if (s == nullptr) {
+    return std::nullopt;
+  }
+  const std::string_view v{s};
+  if (v == "address") return SortBy::kAddress;
+  if (v == "depth") return SortBy::kDepth;
+  if (v == "usage") return SortBy::kUsage;
+  if (v == "span") return SortBy::kSpan;
+  if (v == "age") return SortBy::kAge;
+  return std::nullopt;
+}
+
+const char* ToString(SortBy sort_by) {
+  switch (sort_by) {
+    case SortBy::kAddress:
+      return "stack address";
+    case SortBy::kDepth:
+      return "stack depth";
+    case SortBy::kUsage:
+      return "stack usage";
+    case SortBy::kSpan:
+      return "span name";
+    case SortBy::kAge:
+      return "sleep age";
+  }
+  return "";
+}
+
 BtSettings ParseBtSettings(char** cmd) {
   BtSettings result{};
   for (auto** p = cmd; p != nullptr && *p != nullptr; ++p) {
@@ -523,6 +198,10 @@ BtSettings ParseBtSettings(char** cmd) {
       result.full = true;
       continue;
     }
+    if (std::strcmp(s, "--fast") == 0) {
+      result.fast = true;
+      continue;
+    }
     if (std::strcmp(s, "-s") == 0) {
       if ((p + 1) != nullptr && *(p + 1) != nullptr) {
         const std::string_view v{*(p + 1)};
@@ -533,101 +212,268 @@ BtSettings ParseBtSettings(char** cmd) {
         }
       }
     }
+    if (std::strcmp(s, "--sort") == 0) {
+      const auto sort_by = ParseSortBy(*(p + 1));
+      result.invalid |= !sort_by.has_value();
+      result.sort_by = sort_by.value_or(SortBy::kAddress);
+      if (*(p + 1) != nullptr) ++p;
+      continue;
+    }
+    if (std::strcmp(s, "--offset") == 0) {
+      const auto offset = ParseCount(*(p + 1));
+      result.invalid |= !offset.has_value();
+      result.offset = offset.value_or(0);
+      if (*(p + 1) != nullptr) ++p;
+      continue;
+    }
+    if (std::strcmp(s, "--depth") == 0) {
+      const auto depth = ParseCount(*(p + 1));
+      result.invalid |= !depth.has_value();
+      result.variable_limits.max_depth =
+          depth.value_or(result.variable_limits.max_depth);
+      if (*(p + 1) != nullptr) ++p;
+      continue;
+    }
+    if (std::strcmp(s, "--max-children") == 0) {
+      const auto max_children = ParseCount(*(p + 1));
+      result.invalid |= !max_children.has_value();
+      result.variable_limits.max_children =
+          max_children.value_or(result.variable_limits.max_children);
+      if (*(p + 1) != nullptr) ++p;
+      continue;
+    }
+    if (std::strcmp(s, "--max-bytes") == 0) {
+      const auto max_bytes = ParseCount(*(p + 1));
+      result.invalid |= !max_bytes.has_value();
+      result.variable_limits.max_bytes =
+          max_bytes.value_or(result.variable_limits.max_bytes);
+      if (*(p + 1) != nullptr) ++p;
+      continue;
+    }
+    if (std::strcmp(s, "--limit") == 0) {
+      result.limit = ParseCount(*(p + 1));
+      result.invalid |= !result.limit.has_value();
+      if (*(p + 1) != nullptr) ++p;
+      continue;
+    }
   }
+  // variables need frames LLDB has unwound
+  result.invalid |= result.full && result.fast;
 
   return result;
 }
 
-std::int64_t UpdateRegisterValue(lldb::SBValue& general_purpose_registers,
-                                 lldb::SBCommandReturnObject& result,
-                                 const char* reg_name, std::int64_t reg_value) {
-  auto reg_sb_value =
-      general_purpose_registers.GetChildMemberWithName(reg_name);
-
-  lldb::SBData data{};
-  data.SetDataFromSInt64Array(&reg_value, 1);
-
-  const auto prev = reg_sb_value.GetValueAsSigned();
+// Discovered coroutine along with the key it is ordered by.
+struct SortableCoro final {
+  CoroInfo coro;
+  std::size_t depth{};
+  std::string span_name{};
+  std::optional<std::int64_t> sleep_timepoint{};
+};
 
-  lldb::SBError error{};
-  reg_sb_value.SetData(data, error);
-  if (!error.Success()) {
-    result.Printf("Failed to update '%s' register\n", reg_name);
+// Drops coroutines which don't run a sleeping task: idle ones in the pool
+// keep a stale TaskContext, and the ones on their way to sleep have nothing
+// to unwind yet. Either way they'd be skipped when printing, leaving holes in
+// a page.
+void KeepSuspendedTasks(std::vector<SortableCoro>& coros,
+                        lldb::SBTarget& target,
+                        lldb::SBCommandReturnObject& result) {
+  TaskContextReader task_context_reader{target, result};
+  // With an unknown pull_coroutine layout no TaskContext is decoded at all,
+  // and a null one doesn't mean there is no task.
+  const bool tasks_decoded =
+      std::any_of(coros.begin(), coros.end(), [](const auto& sortable) {
+        return sortable.coro.task_context != 0;
+      });
+  if (coros.empty()) {
+    return;
   }
-
-  return prev;
-}
-
-class CurrentFrameRegistersGuard final {
- public:
-  CurrentFrameRegistersGuard(lldb::SBThread& thread,
-                             lldb::SBCommandReturnObject& result)
-      : thread_{thread}, result_{result} {}
-
-  void ChangeRegisters(const UnwindRegisters& regs) {
-    auto [frame, registers] = GetCurrentFrameRegisters();
-
-    const auto old_regs = UpdateRegs(registers, regs);
-    if (!old_registers_.has_value()) {
-      old_registers_.emplace(old_regs);
-    }
-    frame.SetPC(regs.rip);
+  if (!task_context_reader.IsValid() || !tasks_decoded) {
+    result.Printf(
+        "Tasks of coroutines are not known, coroutines without a sleeping "
+        "task are shown too\n");
+    return;
   }
 
-  ~CurrentFrameRegistersGuard() {
-    if (!old_registers_.has_value()) {
-      return;
+  const auto is_suspended = [&task_context_reader](const auto& sortable) {
+    if (sortable.coro.task_context == 0) {
+      return false;
     }
-    const auto& old_regs = *old_registers_;
-
-    auto [frame, registers] = GetCurrentFrameRegisters();
-    UpdateRegs(registers, old_regs);
-    frame.SetPC(old_regs.rip);
-  }
-
- private:
-  struct FrameRegisters final {
-    lldb::SBFrame frame;
-    lldb::SBValue registers;
+    const auto state =
+        task_context_reader.ReadState(sortable.coro.task_context);
+    if (!state.has_value()) {
+      // no TaskContext::state_ in debug info, can't tell
+      return true;
+    }
+    const auto* state_name = task_context_reader.GetStateName(*state);
+    return state_name != nullptr && kSuspendedTaskState == state_name;
   };
+  coros.erase(std::remove_if(coros.begin(), coros.end(),
+                             [&is_suspended](const auto& sortable) {
+                               return !is_suspended(sortable);
+                             }),
+              coros.end());
+}
 
-  FrameRegisters GetCurrentFrameRegisters() {
-    auto frame = thread_.GetSelectedFrame();
-    auto registers =
-        frame.GetRegisters().GetFirstValueByName("General Purpose Registers");
+// Computes sort keys for all the coroutines and orders them. Keys are taken
+// from discovery data, so nothing here asks LLDB to unwind a stack.
+void SortCoroutines(std::vector<SortableCoro>& coros, SortBy sort_by,
+                    lldb::SBTarget& target, lldb::SBProcess& process,
+                    lldb::SBCommandReturnObject& result) {
+  switch (sort_by) {
+    case SortBy::kAddress:
+      // discovery order already is by stack address
+      break;
+    case SortBy::kDepth:
+      for (auto& sortable : coros) {
+        sortable.depth = GetFramePointerDepth(process, sortable.coro);
+      }
+      std::stable_sort(coros.begin(), coros.end(),
+                       [](const auto& lhs, const auto& rhs) {
+                         return lhs.depth > rhs.depth;
+                       });
+      break;
+    case SortBy::kUsage:
+      std::stable_sort(coros.begin(), coros.end(),
+                       [](const auto& lhs, const auto& rhs) {
+                         return lhs.coro.GetStackUsage() >
+                                rhs.coro.GetStackUsage();
+                       });
+      break;
+    case SortBy::kSpan: {
+      auto task_context_type = target.FindFirstType(kTaskContextTypeName);
+      if (!task_context_type.IsValid()) {
+        result.Printf("Failed to find '%s' type, not sorting by span\n",
+                      kTaskContextTypeName);
+        break;
+      }
+      for (auto& sortable : coros) {
+        if (sortable.coro.task_context == 0) {
+          continue;
+        }
+        const auto span_info = ReadSpanInfo(
+            GetTaskContextValue(target, task_context_type,
+                                sortable.coro.task_context),
+            process, result);
+        if (span_info.has_value()) {
+          sortable.span_name = span_info->name;
+        }
+      }
+      // coroutines without a span go last
+      std::stable_sort(coros.begin(), coros.end(),
+                       [](const auto& lhs, const auto& rhs) {
+                         if (lhs.span_name.empty() != rhs.span_name.empty()) {
+                           return rhs.span_name.empty();
+                         }
+                         return lhs.span_name < rhs.span_name;
+                       });
+    } break;
+    case SortBy::kAge: {
+      TaskContextReader task_context_reader{target, result};
+      for (auto& sortable : coros) {
+        sortable.sleep_timepoint =
+            task_context_reader.ReadSleepTimepoint(sortable.coro.task_context);
+      }
+      // longest sleeping first, coroutines with unknown age go last
+      std::stable_sort(
+          coros.begin(), coros.end(), [](const auto& lhs, const auto& rhs) {
+            if (lhs.sleep_timepoint.has_value() !=
+                rhs.sleep_timepoint.has_value()) {
+              return lhs.sleep_timepoint.has_value();
+            }
+            return lhs.sleep_timepoint < rhs.sleep_timepoint;
+          });
+    } break;
+  }
+}
 
-    return {std::move(frame), std::move(registers)};
+// Prints backtraces of coroutines, unwinding them by following frame
+// pointers instead of asking LLDB to. PCs of all the coroutines are
+// symbolized in one go, and LLDB is only asked about inlined functions of
+// the frames which are printed. Returns the number of coroutines printed.
+std::size_t FastBacktrace(const std::vector<SortableCoro>& coros,
+                          const std::optional<TargetNow>& now,
+                          lldb::SBTarget& target, lldb::SBProcess& process,
+                          lldb::SBCommandInterpreter& interpreter,
+                          lldb::SBCommandReturnObject& result) {
+  std::vector<CoroInfo> coro_infos;
+  coro_infos.reserve(coros.size());
+  for (const auto& sortable : coros) {
+    coro_infos.push_back(sortable.coro);
+  }
+  const auto stacks =
+      GetSymbolizedStacks(target, process, coro_infos, interpreter);
+  if (!stacks.has_value()) {
+    return 0;
   }
 
-  UnwindRegisters UpdateRegs(lldb::SBValue& lldb_registers,
-                             const UnwindRegisters& regs) {
-    const auto old_rsp =
-        UpdateRegisterValue(lldb_registers, result_, "rsp", regs.rsp);
-    const auto old_rbp =
-        UpdateRegisterValue(lldb_registers, result_, "rbp", regs.rbp);
-    const auto old_rip =
-        UpdateRegisterValue(lldb_registers, result_, "rip", regs.rip);
+  SleepFramesCounter sleep_frames_counter{target};
+  auto task_context_type = target.FindFirstType(kTaskContextTypeName);
+  std::size_t found = 0;
+  for (std::size_t i = 0; i < coros.size(); ++i) {
+    if (interpreter.WasInterrupted()) {
+      break;
+    }
 
-    return {old_rsp, old_rbp, old_rip};
+    const auto& stack = (*stacks)[i];
+    const auto num_frames = sleep_frames_counter.Count(stack);
+    if (!num_frames.has_value()) {
+      continue;
+    }
+    ++found;
+
+    const auto& coro = coros[i].coro;
+    std::optional<SpanInfo> span_info;
+    if (coro.task_context != 0 && task_context_type.IsValid()) {
+      span_info = ReadSpanInfo(
+          GetTaskContextValue(target, task_context_type, coro.task_context),
+          process, result);
+    }
+    std::optional<std::int64_t> sleep_age;
+    if (now.has_value() && coros[i].sleep_timepoint.has_value()) {
+      sleep_age = now->nanoseconds - *coros[i].sleep_timepoint;
+    }
+    PrintCoroutineHeader(coro.GetStackAddress(), sleep_age, span_info,
+                         result);
+
+    std::size_t frame_index = 0;
+    for (std::size_t j = 0; j < *num_frames; ++j) {
+      const auto pc = static_cast<unsigned long>(stack.pcs[j]);
+      for (const auto& inlined :
+           GetInlinedFunctions(target, stack.GetLookupPc(j))) {
+        result.Printf("frame #%zu: 0x%016lx %s [inlined]\n", frame_index++,
+                      pc, inlined.data());
+      }
+      if (stack.names[j] != nullptr) {
+        const auto offset =
+            static_cast<unsigned long>(stack.pcs[j] - stack.function_starts[j]);
+        result.Printf("frame #%zu: 0x%016lx %s + %lu\n", frame_index++, pc,
+                      stack.names[j], offset);
+      } else {
+        result.Printf("frame #%zu: 0x%016lx\n", frame_index++, pc);
+      }
+    }
   }
 
-  lldb::SBThread& thread_;
-  lldb::SBCommandReturnObject& result_;
-  std::optional<UnwindRegisters> old_registers_;
-};
+  return found;
+}
 
 }  // namespace
 
 bool BacktraceCmd::RealExecute(lldb::SBDebugger debugger, char** cmd,
                                lldb::SBCommandReturnObject& result) {
   const auto bt_settings = ParseBtSettings(cmd);
+  if (bt_settings.invalid) {
+    result.Printf("Failed to parse bt options\n");
+    return false;
+  }
 
   const auto* settings_ptr = GetSettings();
   if (settings_ptr == nullptr) {
     result.Printf("LLC2 plugin is not initialized\n");
     return false;
   }
-  terminal_width = debugger.GetTerminalWidth();
+  SetTerminalWidth(debugger.GetTerminalWidth());
 
   auto target = debugger.GetSelectedTarget();
   if (!target.IsValid()) {
@@ -647,33 +493,137 @@ bool BacktraceCmd::RealExecute(lldb::SBDebugger debugger, char** cmd,
 
   const ScopeTimer total{result, "llc2 bt"};
 
-  const auto memory_regions = GetProcessMemoryRegions(process, result);
-  CurrentFrameRegistersGuard regs_guard{thread, result};
-  for (const auto& memory_region : memory_regions) {
-    const auto length = memory_region.end - memory_region.begin;
-    if (length != settings_ptr->GetRealStackSize()) {
-      continue;
+  auto interpreter = debugger.GetCommandInterpreter();
+
+  std::vector<SortableCoro> coros;
+  {
+    const auto* decoder = GetDecoder(process, result);
+    if (decoder == nullptr) {
+      return false;
     }
+    const auto candidates = GetCandidateStacks(process, result);
+    ScanProgress discovery_progress{"llc2 bt: discovering coroutines",
+                                    debugger, candidates.size(),
+                                    "candidate stacks"};
+    for (const auto& candidate : candidates) {
+      if (interpreter.WasInterrupted()) {
+        result.Printf(
+            "Interrupted while discovering coroutines: %zu of %zu candidate "
+            "stacks scanned\n",
+            discovery_progress.GetScanned(), discovery_progress.GetTotal());
+        return true;
+      }
+      discovery_progress.Increment();
 
-    // this doesn't directly relate to neither stack bottom nor stack top
-    const auto stack_address = memory_region.begin;
+      if (bt_settings.stack_address.value_or(candidate.begin) !=
+          candidate.begin) {
+        continue;
+      }
 
-    if (bt_settings.stack_address.value_or(stack_address) != stack_address) {
-      continue;
+      auto coro = TryDiscoverCoroutine(process, result, *decoder, candidate);
+      if (coro.has_value()) {
+        coros.push_back(SortableCoro{std::move(*coro)});
+      }
     }
+  }
 
-    auto unwind_registers_ptr =
-        TryFindCoroRegisters(process, result, memory_region);
-    if (unwind_registers_ptr != nullptr) {
-      ScopeTimer coro_bt_timer{result, "coro backtrace"};
-      const auto& regs = *unwind_registers_ptr;
-      regs_guard.ChangeRegisters(regs);
-      if (!BacktraceCoroutine(stack_address, thread, result,
-                              bt_settings.full)) {
-        coro_bt_timer.Disarm();
-      }
+  const bool paged = bt_settings.limit.has_value() || bt_settings.offset != 0;
+  const bool ordered = paged || bt_settings.sort_by != SortBy::kAddress;
+  std::size_t offset = 0;
+  std::size_t suspended = 0;
+  // Without the target clock, "now" is estimated by the newest sleep, which
+  // has to be found before the page drops it.
+  std::optional<std::int64_t> newest_timestamp;
+  if (ordered) {
+    KeepSuspendedTasks(coros, target, result);
+    suspended = coros.size();
+    SortCoroutines(coros, bt_settings.sort_by, target, process, result);
+    for (const auto& sortable : coros) {
+      newest_timestamp = std::max(newest_timestamp, sortable.sleep_timepoint);
     }
+
+    // Everything outside of the page is dropped before unwinding.
+    offset = std::min(bt_settings.offset, coros.size());
+    const auto limit = std::min(bt_settings.limit.value_or(coros.size()),
+                                coros.size() - offset);
+    coros.erase(coros.begin() + offset + limit, coros.end());
+    coros.erase(coros.begin(), coros.begin() + offset);
+  }
+  // A task may still wake up or finish while it's being unwound, so the
+  // page is told about once it's printed.
+  const auto print_page = [&](std::size_t found) {
+    if (ordered) {
+      result.Printf(
+          "Printed %zu coroutines (%zu-%zu of %zu suspended, sorted by %s)\n",
+          found, offset, offset + coros.size(), suspended,
+          ToString(bt_settings.sort_by));
+    }
+  };
+
+  std::optional<TargetNow> now;
+  if (bt_settings.sort_by == SortBy::kAge) {
+    now = GetTargetNow(target, newest_timestamp);
+    if (now.has_value() && now->estimated) {
+      result.Printf(
+          "Target clock is not available, sleep ages are relative to the "
+          "newest engine timestamp\n");
+    }
+  }
+
+  if (bt_settings.fast) {
+    const auto found = FastBacktrace(coros, now, target, process, interpreter,
+                                     result);
+    if (interpreter.WasInterrupted()) {
+      result.Printf("Interrupted: %zu sleeping coroutines printed\n", found);
+    }
+    print_page(found);
+    return true;
+  }
+
+  std::optional<VariableDumper> variable_dumper;
+  if (bt_settings.full) {
+    variable_dumper.emplace(bt_settings.variable_limits);
+  }
+
+  ScanProgress progress{"llc2 bt", debugger, coros.size()};
+  std::size_t found = 0;
+  bool interrupted = false;
+
+  CurrentFrameRegistersGuard regs_guard{thread, result};
+  for (const auto& sortable : coros) {
+    // Ctrl-C only sets a flag, so we have to poll it ourselves. Coroutines
+    // printed so far stay in the output, and regs_guard restores registers
+    // on the way out.
+    if (interpreter.WasInterrupted()) {
+      interrupted = true;
+      break;
+    }
+
+    ScopeTimer coro_bt_timer{result, "coro backtrace"};
+    regs_guard.ChangeRegisters(sortable.coro.registers);
+    std::optional<std::int64_t> sleep_age;
+    if (now.has_value() && sortable.sleep_timepoint.has_value()) {
+      sleep_age = now->nanoseconds - *sortable.sleep_timepoint;
+    }
+
+    if (BacktraceCoroutine(
+            sortable.coro.GetStackAddress(), sleep_age, thread, result,
+            variable_dumper.has_value() ? &*variable_dumper : nullptr)) {
+      ++found;
+    } else {
+      coro_bt_timer.Disarm();
+    }
+
+    progress.Increment();
+  }
+
+  if (interrupted) {
+    result.Printf(
+        "Interrupted: %zu of %zu coroutines scanned, %zu sleeping "
+        "coroutines found\n",
+        progress.GetScanned(), progress.GetTotal(), found);
   }
+  print_page(found);
 
   return true;
 }
@@ -0,0 +1,220 @@
+#include "llc2_coros_cmd.hpp"
+
+#include "coroutine_index.hpp"
+#include "discovery.hpp"
+#include "settings.hpp"
+#include "utils.hpp"
+
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBTarget.h>
+
+namespace llc2 {
+
+namespace {
+
+struct CorosSettings final {
+  // coroutine status: complete, suspended or running
+  std::optional<std::string> status;
+  std::optional<std::string> task_processor;
+  // substring of the span name
+  std::optional<std::string> span;
+  std::size_t offset{0};
+  std::optional<std::size_t> limit;
+  bool invalid{false};
+};
+
+CorosSettings ParseCorosSettings(char** cmd) {
+  CorosSettings result{};
+  for (auto** p = cmd; p != nullptr && *p != nullptr; ++p) {
+    const auto* s = *p;
+    if (std::strcmp(s, "--status") == 0 ||
+        std::strcmp(s, "--task-processor") == 0 ||
+        std::strcmp(s, "--span") == 0) {
+      const auto* value = *(p + 1);
+      result.invalid |= value == nullptr;
+      if (value == nullptr) {
+        continue;
+      }
+      ++p;
+      if (std::strcmp(s, "--status") == 0) {
+        result.status.emplace(value);
+      } else if (std::strcmp(s, "--task-processor") == 0) {
+        result.task_processor.emplace(value);
+      } else {
+        result.span.emplace(value);
+      }
+      continue;
+    }
+    if (std::strcmp(s, "--offset") == 0) {
+      const auto offset = ParseCount(*(p + 1));
+      result.invalid |= !offset.has_value();
+      result.offset = offset.value_or(0);
+      if (*(p + 1) != nullptr) ++p;
+      continue;
+    }
+    if (std::strcmp(s, "--limit") == 0) {
+      result.limit = ParseCount(*(p + 1));
+      result.invalid |= !result.limit.has_value();
+      if (*(p + 1) != nullptr) ++p;
+      continue;
+    }
+  }
+  return result;
+}
+
+bool Matches(const IndexedCoroutine& coroutine,
+             const CorosSettings& coros_settings) {
+  if (coros_settings.status.has_value() &&
+      *coros_settings.status != GetCoroutineStatus(coroutine.stack)) {
+    return false;
+  }
+  if (coros_settings.task_processor.has_value() &&
+      coroutine.task_processor != coros_settings.task_processor) {
+    return false;
+  }
+  if (coros_settings.span.has_value() &&
+      (!coroutine.span.has_value() ||
+       coroutine.span->name.find(*coros_settings.span) == std::string::npos)) {
+    return false;
+  }
+  return true;
+}
+
+void AppendOptionalJsonString(std::string& out,
+                              const std::optional<std::string>& s) {
+  if (s.has_value()) {
+    AppendJsonString(out, *s);
+  } else {
+    out.append("null");
+  }
+}
+
+void AppendCoroutineJson(std::string& out, const IndexedCoroutine& coroutine) {
+  const auto& stack = coroutine.stack;
+  out.append("{\"stack_address\":")
+      .append(std::to_string(stack.GetStackAddress()))
+      .append(",\"stack_end\":")
+      .append(std::to_string(stack.region.end))
+      .append(",\"status\":");
+  AppendJsonString(out, GetCoroutineStatus(stack));
+  out.append(",\"boost_state\":")
+      .append(std::to_string(static_cast<unsigned int>(stack.state)))
+      .append(",\"task_context\":")
+      .append(std::to_string(stack.task_context))
+      .append(",\"registers\":");
+  if (coroutine.registers.has_value()) {
+    out.append("{\"rsp\":")
+        .append(std::to_string(coroutine.registers->rsp))
+        .append(",\"rbp\":")
+        .append(std::to_string(coroutine.registers->rbp))
+        .append(",\"rip\":")
+        .append(std::to_string(coroutine.registers->rip))
+        .append("}");
+  } else {
+    out.append("null");
+  }
+  out.append(",\"task_processor\":");
+  AppendOptionalJsonString(out, coroutine.task_processor);
+  out.append(",\"task_state\":");
+  AppendOptionalJsonString(out, coroutine.task_state);
+  out.append(",\"idle\":").append(coroutine.idle ? "true" : "false");
+  out.append(",\"span\":");
+  if (coroutine.span.has_value()) {
+    out.append("{\"name\":");
+    AppendJsonString(out, coroutine.span->name);
+    out.append(",\"span_id\":");
+    AppendJsonString(out, coroutine.span->span_id);
+    out.append(",\"trace_id\":");
+    AppendJsonString(out, coroutine.span->trace_id);
+    out.append("}");
+  } else {
+    out.append("null");
+  }
+  out.append("}");
+}
+
+}  // namespace
+
+bool CorosCmd::RealExecute(lldb::SBDebugger debugger, char** cmd,
+                           lldb::SBCommandReturnObject& result) {
+  const auto coros_settings = ParseCorosSettings(cmd);
+  if (coros_settings.invalid) {
+    result.Printf("Failed to parse coros options\n");
+    return false;
+  }
+
+  if (GetSettings() == nullptr) {
+    result.Printf("LLC2 plugin is not initialized\n");
+    return false;
+  }
+
+  auto target = debugger.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.Printf("No target selected\n");
+    return false;
+  }
+  auto process = target.GetProcess();
+  if (!process.IsValid()) {
+    result.Printf("No process launched\n");
+    return false;
+  }
+
+  // Whatever discovery has to say goes into the "messages" member, so that
+  // the output stays a single JSON document.
+  lldb::SBCommandReturnObject diagnostics{};
+  const auto* decoder = GetDecoder(process, diagnostics);
+  if (decoder == nullptr) {
+    const auto* messages = diagnostics.GetOutput();
+    result.Printf("%s", messages != nullptr ? messages : "");
+    return false;
+  }
+  const auto* coroutines =
+      GetCoroutineIndex(debugger, process, *decoder, diagnostics);
+  if (coroutines == nullptr) {
+    result.Printf("Interrupted while discovering coroutines\n");
+    return false;
+  }
+
+  std::string json{"{\"process_id\":"};
+  json.append(std::to_string(process.GetUniqueID()))
+      .append(",\"stop_id\":")
+      .append(std::to_string(process.GetStopID()))
+      .append(",\"total\":")
+      .append(std::to_string(coroutines->size()))
+      .append(",\"coroutines\":[");
+
+  std::size_t matched = 0;
+  std::size_t printed = 0;
+  for (const auto& coroutine : *coroutines) {
+    if (!Matches(coroutine, coros_settings)) {
+      continue;
+    }
+    if (matched++ < coros_settings.offset) {
+      continue;
+    }
+    if (printed == coros_settings.limit.value_or(coroutines->size())) {
+      continue;
+    }
+    if (printed++ != 0) {
+      json.push_back(',');
+    }
+    AppendCoroutineJson(json, coroutine);
+  }
+
+  json.append("],\"matched\":")
+      .append(std::to_string(matched))
+      .append(",\"messages\":");
+  const auto* messages = diagnostics.GetOutput();
+  AppendJsonString(json, messages != nullptr ? messages : "");
+  json.append("}");
+
+  result.AppendMessage(json.data());
+  return true;
+}
+
+}  // namespace llc2
@@ -0,0 +1,270 @@
+#include "llc2_diff_cmd.hpp"
+
+#include "discovery.hpp"
+#include "settings.hpp"
+#include "snapshot.hpp"
+#include "userver.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBTarget.h>
+
+namespace llc2 {
+
+namespace {
+
+// Frames of a stack shown along with a group, starting with the caller of
+// TaskContext::Sleep, which is what tells groups apart.
+constexpr std::size_t kShownFrames = 5;
+
+struct DiffSettings final {
+  std::size_t top{20};
+  std::vector<std::string> paths;
+  bool invalid{false};
+};
+
+DiffSettings ParseDiffSettings(char** cmd) {
+  DiffSettings result{};
+  for (auto** p = cmd; p != nullptr && *p != nullptr; ++p) {
+    if (std::strcmp(*p, "-n") == 0) {
+      const auto top = ParseCount(*(p + 1));
+      result.invalid |= !top.has_value();
+      result.top = top.value_or(result.top);
+      if (*(p + 1) != nullptr) ++p;
+      continue;
+    }
+    result.paths.emplace_back(*p);
+  }
+  result.invalid |= result.paths.empty() || result.paths.size() > 2;
+  return result;
+}
+
+// Coroutines with the same stack and span.
+struct Group final {
+  std::uint64_t signature{};
+  const std::string* span_name{};
+  std::size_t count[2]{};
+
+  std::int64_t GetDelta() const {
+    return static_cast<std::int64_t>(count[1]) -
+           static_cast<std::int64_t>(count[0]);
+  }
+};
+
+std::uint64_t GetGroupKey(const SnapshotCoroutine& coroutine) {
+  return coroutine.signature ^
+         (std::hash<std::string>{}(coroutine.span_name) * 0x9e3779b97f4a7c15);
+}
+
+const std::vector<std::string>* FindFrames(const Snapshot (&snapshots)[2],
+                                           std::uint64_t signature) {
+  for (const auto& snapshot : snapshots) {
+    const auto it = snapshot.signatures.find(signature);
+    if (it != snapshot.signatures.end()) {
+      return &it->second;
+    }
+  }
+  return nullptr;
+}
+
+// Index of the first frame worth showing: the caller of TaskContext::Sleep.
+std::size_t GetFirstShownFrame(const std::vector<std::string>& frames) {
+  for (std::size_t i = 0; i < frames.size(); ++i) {
+    if (frames[i].find(kUserverSleepMark) != std::string::npos) {
+      return std::min(i + 1, frames.size());
+    }
+  }
+  return 0;
+}
+
+enum class Change { kAppeared, kDisappeared, kGrew, kShrank };
+
+Change GetChange(const Group& group) {
+  if (group.count[0] == 0) return Change::kAppeared;
+  if (group.count[1] == 0) return Change::kDisappeared;
+  return group.GetDelta() > 0 ? Change::kGrew : Change::kShrank;
+}
+
+const char* ToString(Change change) {
+  switch (change) {
+    case Change::kAppeared:
+      return "appeared";
+    case Change::kDisappeared:
+      return "disappeared";
+    case Change::kGrew:
+      return "grew";
+    case Change::kShrank:
+      return "shrank";
+  }
+  return "";
+}
+
+std::optional<Snapshot> GetSnapshot(lldb::SBDebugger& debugger,
+                                    const std::optional<std::string>& path,
+                                    lldb::SBCommandReturnObject& result) {
+  if (path.has_value()) {
+    return LoadSnapshot(*path, result);
+  }
+
+  if (GetSettings() == nullptr) {
+    result.Printf("LLC2 plugin is not initialized\n");
+    return std::nullopt;
+  }
+  auto target = debugger.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.Printf("No target selected\n");
+    return std::nullopt;
+  }
+  auto process = target.GetProcess();
+  if (!process.IsValid()) {
+    result.Printf("No process launched\n");
+    return std::nullopt;
+  }
+  const auto* decoder = GetDecoder(process, result);
+  if (decoder == nullptr) {
+    return std::nullopt;
+  }
+  auto snapshot = TakeSnapshot(debugger, process, *decoder, result);
+  if (!snapshot.has_value()) {
+    result.Printf("Interrupted while taking a snapshot\n");
+  }
+  return snapshot;
+}
+
+}  // namespace
+
+bool DiffCmd::RealExecute(lldb::SBDebugger debugger, char** cmd,
+                          lldb::SBCommandReturnObject& result) {
+  const auto diff_settings = ParseDiffSettings(cmd);
+  if (diff_settings.invalid) {
+    result.Printf("Failed to parse diff options\n");
+    return false;
+  }
+  SetTerminalWidth(debugger.GetTerminalWidth());
+
+  // the second one defaults to the current process
+  const std::optional<std::string> paths[2] = {
+      diff_settings.paths[0],
+      diff_settings.paths.size() > 1
+          ? std::optional<std::string>{diff_settings.paths[1]}
+          : std::nullopt};
+  Snapshot snapshots[2];
+  for (std::size_t i = 0; i < 2; ++i) {
+    auto snapshot = GetSnapshot(debugger, paths[i], result);
+    if (!snapshot.has_value()) {
+      return false;
+    }
+    snapshots[i] = std::move(*snapshot);
+  }
+
+  std::unordered_map<std::uint64_t, Group> groups;
+  for (std::size_t i = 0; i < 2; ++i) {
+    for (const auto& coroutine : snapshots[i].coroutines) {
+      auto& group = groups[GetGroupKey(coroutine)];
+      group.signature = coroutine.signature;
+      group.span_name = &coroutine.span_name;
+      ++group.count[i];
+    }
+  }
+
+  std::vector<const Group*> changed;
+  // indexed by Change
+  std::size_t counts[4]{};
+  for (const auto& [key, group] : groups) {
+    if (group.GetDelta() == 0) {
+      continue;
+    }
+    changed.push_back(&group);
+    ++counts[static_cast<std::size_t>(GetChange(group))];
+  }
+  std::sort(changed.begin(), changed.end(),
+            [](const auto* lhs, const auto* rhs) {
+              const auto lhs_delta = std::abs(lhs->GetDelta());
+              const auto rhs_delta = std::abs(rhs->GetDelta());
+              if (lhs_delta != rhs_delta) {
+                return lhs_delta > rhs_delta;
+              }
+              return lhs->count[1] > rhs->count[1];
+            });
+
+  const auto title = GetFullWidth("SLEEPING COROUTINES DIFF", true);
+  result.AppendMessage(title.data());
+  result.Printf("a: %s, %zu sleeping coroutines\n", paths[0]->data(),
+                snapshots[0].coroutines.size());
+  result.Printf("b: %s, %zu sleeping coroutines\n",
+                paths[1].has_value() ? paths[1]->data() : "current process",
+                snapshots[1].coroutines.size());
+  result.Printf(
+      "groups by stack and span: %zu appeared, %zu disappeared, %zu grew, "
+      "%zu shrank, %zu unchanged\n",
+      counts[0], counts[1], counts[2], counts[3],
+      groups.size() - changed.size());
+
+  for (std::size_t i = 0; i < std::min(diff_settings.top, changed.size());
+       ++i) {
+    const auto& group = *changed[i];
+    const auto printed = result.Printf(
+        "%+ld (%zu -> %zu) %s | span: %s", static_cast<long>(group.GetDelta()),
+        group.count[0], group.count[1], ToString(GetChange(group)),
+        group.span_name->empty() ? "(none)" : group.span_name->data());
+    result.Printf("\n%s\n", std::string{GetDashesSw(printed)}.data());
+
+    const auto* frames = FindFrames(snapshots, group.signature);
+    if (frames == nullptr) {
+      continue;
+    }
+    const auto first = GetFirstShownFrame(*frames);
+    const auto last = std::min(first + kShownFrames, frames->size());
+    for (auto j = first; j < last; ++j) {
+      result.Printf("  %s\n", (*frames)[j].data());
+    }
+  }
+
+  // Same task in the same sleep: the coroutine hasn't moved.
+  std::unordered_map<std::uintptr_t, const SnapshotCoroutine*> before;
+  for (const auto& coroutine : snapshots[0].coroutines) {
+    before.emplace(coroutine.stack_address, &coroutine);
+  }
+  std::vector<const SnapshotCoroutine*> stayed;
+  for (const auto& coroutine : snapshots[1].coroutines) {
+    const auto it = before.find(coroutine.stack_address);
+    if (it != before.end() && it->second->IsSameSleep(coroutine)) {
+      stayed.push_back(&coroutine);
+    }
+  }
+
+  const auto stayed_title = GetFullWidth("STUCK IN THE SAME SLEEP", true);
+  result.AppendMessage(stayed_title.data());
+  result.Printf(
+      "%zu coroutines are in the same sleep of the same task in both\n",
+      stayed.size());
+  for (std::size_t i = 0; i < std::min(diff_settings.top, stayed.size());
+       ++i) {
+    const auto& coroutine = *stayed[i];
+    const auto* frames = FindFrames(snapshots, coroutine.signature);
+    const auto first =
+        frames != nullptr ? GetFirstShownFrame(*frames) : std::size_t{0};
+    result.Printf("coro stack address: %p | task: %p | %s | span: %s\n",
+                  reinterpret_cast<void*>(coroutine.stack_address),
+                  reinterpret_cast<void*>(coroutine.task_context),
+                  frames != nullptr && first < frames->size()
+                      ? (*frames)[first].data()
+                      : "??",
+                  coroutine.span_name.empty() ? "(none)"
+                                              : coroutine.span_name.data());
+  }
+
+  return true;
+}
+
+}  // namespace llc2
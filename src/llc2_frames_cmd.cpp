@@ -0,0 +1,173 @@
+#include "llc2_frames_cmd.hpp"
+
+#include "coroutine_index.hpp"
+#include "discovery.hpp"
+#include "registers_guard.hpp"
+#include "settings.hpp"
+#include "userver.hpp"
+#include "utils.hpp"
+
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <lldb/API/SBFileSpec.h>
+#include <lldb/API/SBFrame.h>
+#include <lldb/API/SBLineEntry.h>
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBTarget.h>
+#include <lldb/API/SBThread.h>
+
+namespace llc2 {
+
+namespace {
+
+std::optional<std::uintptr_t> ParseStackAddress(const char* s) {
+  const std::string_view v{s};
+  char* end = nullptr;
+  const std::uintptr_t stack_address = std::strtoul(v.data(), &end, 16);
+  if (v.empty() || end != v.data() + v.size()) {
+    return std::nullopt;
+  }
+  return stack_address;
+}
+
+void AppendFrameJson(std::string& out, lldb::SBFrame& frame) {
+  out.append("{\"pc\":").append(std::to_string(frame.GetPC()));
+  out.append(",\"function\":");
+  const auto* function_name = frame.GetFunctionName();
+  AppendJsonString(out, function_name != nullptr ? function_name : "");
+
+  out.append(",\"file\":");
+  const auto line_entry = frame.GetLineEntry();
+  const auto file_spec = line_entry.GetFileSpec();
+  if (line_entry.IsValid() && file_spec.IsValid()) {
+    char path[4096];
+    file_spec.GetPath(path, sizeof(path));
+    AppendJsonString(out, path);
+    out.append(",\"line\":").append(std::to_string(line_entry.GetLine()));
+  } else {
+    out.append("null,\"line\":null");
+  }
+  out.append(",\"inlined\":").append(frame.IsInlined() ? "true" : "false");
+  out.append("}");
+}
+
+// Frames of the coroutine up to WrappedCallImpl, the same ones 'llc2 bt'
+// prints.
+void AppendFramesJson(std::string& out, lldb::SBThread& thread) {
+  out.append("[");
+  const auto num_frames = thread.GetNumFrames();
+  for (std::uint32_t i = 0; i < num_frames; ++i) {
+    auto frame = thread.GetFrameAtIndex(i);
+    const auto* function_name = frame.GetFunctionName();
+    if (function_name != nullptr &&
+        std::string_view{function_name}.find(kUserverWrappedCallImplMark) !=
+            std::string_view::npos) {
+      break;
+    }
+    if (i != 0) {
+      out.push_back(',');
+    }
+    AppendFrameJson(out, frame);
+  }
+  out.append("]");
+}
+
+}  // namespace
+
+bool FramesCmd::RealExecute(lldb::SBDebugger debugger, char** cmd,
+                            lldb::SBCommandReturnObject& result) {
+  std::vector<std::uintptr_t> stack_addresses;
+  for (auto** p = cmd; p != nullptr && *p != nullptr; ++p) {
+    const auto stack_address = ParseStackAddress(*p);
+    if (!stack_address.has_value()) {
+      result.Printf("Failed to parse frames options\n");
+      return false;
+    }
+    stack_addresses.push_back(*stack_address);
+  }
+  if (stack_addresses.empty()) {
+    result.Printf("No coroutine stack addresses given\n");
+    return false;
+  }
+
+  if (GetSettings() == nullptr) {
+    result.Printf("LLC2 plugin is not initialized\n");
+    return false;
+  }
+
+  auto target = debugger.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.Printf("No target selected\n");
+    return false;
+  }
+  auto process = target.GetProcess();
+  if (!process.IsValid()) {
+    result.Printf("No process launched\n");
+    return false;
+  }
+  auto thread = process.GetSelectedThread();
+  if (!thread.IsValid()) {
+    result.Printf("No thread selected\n");
+    return false;
+  }
+
+  lldb::SBCommandReturnObject diagnostics{};
+  const auto* decoder = GetDecoder(process, diagnostics);
+  if (decoder == nullptr) {
+    const auto* messages = diagnostics.GetOutput();
+    result.Printf("%s", messages != nullptr ? messages : "");
+    return false;
+  }
+  const auto* coroutines =
+      GetCoroutineIndex(debugger, process, *decoder, diagnostics);
+  if (coroutines == nullptr) {
+    result.Printf("Interrupted while discovering coroutines\n");
+    return false;
+  }
+
+  auto interpreter = debugger.GetCommandInterpreter();
+  std::string json{"{\"coroutines\":["};
+  {
+    CurrentFrameRegistersGuard regs_guard{thread, diagnostics};
+    for (std::size_t i = 0; i < stack_addresses.size(); ++i) {
+      if (interpreter.WasInterrupted()) {
+        result.Printf("Interrupted while unwinding coroutines\n");
+        return false;
+      }
+
+      if (i != 0) {
+        json.push_back(',');
+      }
+      json.append("{\"stack_address\":")
+          .append(std::to_string(stack_addresses[i]));
+
+      const auto* coroutine = FindCoroutine(*coroutines, stack_addresses[i]);
+      if (coroutine == nullptr || !coroutine->registers.has_value()) {
+        json.append(",\"frames\":null,\"error\":");
+        AppendJsonString(json, coroutine == nullptr ? "not a coroutine"
+                                                    : "not suspended");
+        json.append("}");
+        continue;
+      }
+
+      regs_guard.ChangeRegisters(*coroutine->registers);
+      json.append(",\"frames\":");
+      AppendFramesJson(json, thread);
+      json.append("}");
+    }
+  }
+
+  json.append("],\"messages\":");
+  const auto* messages = diagnostics.GetOutput();
+  AppendJsonString(json, messages != nullptr ? messages : "");
+  json.append("}");
+
+  result.AppendMessage(json.data());
+  return true;
+}
+
+}  // namespace llc2
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "base_cmd.hpp"
+
+namespace llc2 {
+
+class FramesCmd final : public CmdBase {
+ public:
+  bool RealExecute(lldb::SBDebugger, char**,
+                   lldb::SBCommandReturnObject&) final;
+};
+
+}  // namespace llc2
@@ -0,0 +1,61 @@
+#include "llc2_save_cmd.hpp"
+
+#include "discovery.hpp"
+#include "settings.hpp"
+#include "snapshot.hpp"
+#include "utils.hpp"
+
+#include <string>
+
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBTarget.h>
+
+namespace llc2 {
+
+bool SaveCmd::RealExecute(lldb::SBDebugger debugger, char** cmd,
+                          lldb::SBCommandReturnObject& result) {
+  if (cmd == nullptr || cmd[0] == nullptr || cmd[1] != nullptr) {
+    result.Printf("Expected a single file name\n");
+    return false;
+  }
+  const std::string path{cmd[0]};
+
+  if (GetSettings() == nullptr) {
+    result.Printf("LLC2 plugin is not initialized\n");
+    return false;
+  }
+
+  auto target = debugger.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.Printf("No target selected\n");
+    return false;
+  }
+  auto process = target.GetProcess();
+  if (!process.IsValid()) {
+    result.Printf("No process launched\n");
+    return false;
+  }
+
+  const ScopeTimer total{result, "llc2 save"};
+
+  const auto* decoder = GetDecoder(process, result);
+  if (decoder == nullptr) {
+    return false;
+  }
+  const auto snapshot = TakeSnapshot(debugger, process, *decoder, result);
+  if (!snapshot.has_value()) {
+    result.Printf("Interrupted, nothing is saved\n");
+    return true;
+  }
+  if (!SaveSnapshot(*snapshot, path, result)) {
+    return false;
+  }
+
+  result.Printf("Saved %zu sleeping coroutines with %zu distinct stacks to "
+                "'%s'\n",
+                snapshot->coroutines.size(), snapshot->signatures.size(),
+                path.data());
+  return true;
+}
+
+}  // namespace llc2
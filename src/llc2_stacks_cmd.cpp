@@ -0,0 +1,215 @@
+#include "llc2_stacks_cmd.hpp"
+
+#include "coroutine_index.hpp"
+#include "discovery.hpp"
+#include "residency.hpp"
+#include "settings.hpp"
+#include "utils.hpp"
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBTarget.h>
+
+namespace llc2 {
+
+namespace {
+
+constexpr const char* kNoTaskProcessor = "(none)";
+
+struct StacksSettings final {
+  bool rss{false};
+  bool per_stack{false};
+  bool invalid{false};
+};
+
+StacksSettings ParseStacksSettings(char** cmd) {
+  StacksSettings result{};
+  for (auto** p = cmd; p != nullptr && *p != nullptr; ++p) {
+    if (std::strcmp(*p, "--rss") == 0) {
+      result.rss = true;
+      continue;
+    }
+    if (std::strcmp(*p, "--per-stack") == 0) {
+      result.per_stack = true;
+      continue;
+    }
+  }
+  result.invalid |= result.per_stack && !result.rss;
+  return result;
+}
+
+struct StacksUsage final {
+  std::size_t stacks{};
+  PageCounts pages{};
+};
+
+// Coroutine sitting in the pool: it either never ran a task, or the task is
+// done with it.
+bool IsPooled(const IndexedCoroutine& coroutine) {
+  return coroutine.idle || coroutine.stack.task_context == 0;
+}
+
+void PrintUsage(const char* name, const StacksUsage& usage, bool rss,
+                std::size_t page_size, lldb::SBCommandReturnObject& result) {
+  result.Printf("  %-8s %6zu stacks", name, usage.stacks);
+  if (rss) {
+    const auto resident = usage.pages.resident * page_size;
+    result.Printf(" | resident: %s (%s per stack)", FormatSize(resident).data(),
+                  FormatSize(usage.stacks != 0 ? resident / usage.stacks : 0)
+                      .data());
+    if (usage.pages.swapped != 0) {
+      result.Printf(" | swapped: %s",
+                    FormatSize(usage.pages.swapped * page_size).data());
+    }
+  }
+  result.Printf("\n");
+}
+
+}  // namespace
+
+bool StacksCmd::RealExecute(lldb::SBDebugger debugger, char** cmd,
+                            lldb::SBCommandReturnObject& result) {
+  const auto stacks_settings = ParseStacksSettings(cmd);
+  if (stacks_settings.invalid) {
+    result.Printf("Failed to parse stacks options\n");
+    return false;
+  }
+
+  const auto* settings = GetSettings();
+  if (settings == nullptr) {
+    result.Printf("LLC2 plugin is not initialized\n");
+    return false;
+  }
+  SetTerminalWidth(debugger.GetTerminalWidth());
+
+  auto target = debugger.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.Printf("No target selected\n");
+    return false;
+  }
+  auto process = target.GetProcess();
+  if (!process.IsValid()) {
+    result.Printf("No process launched\n");
+    return false;
+  }
+
+  std::unique_ptr<ResidencyReader> residency;
+  if (stacks_settings.rss) {
+    residency = ResidencyReader::Create(target, process, result);
+    if (residency == nullptr) {
+      return false;
+    }
+  }
+
+  const ScopeTimer total{result, "llc2 stacks"};
+
+  const auto* decoder = GetDecoder(process, result);
+  if (decoder == nullptr) {
+    return false;
+  }
+  const auto* coroutines =
+      GetCoroutineIndex(debugger, process, *decoder, result);
+  if (coroutines == nullptr) {
+    result.Printf("Interrupted while discovering coroutines\n");
+    return true;
+  }
+
+  const auto page_size =
+      residency != nullptr ? residency->GetPageSize() : std::size_t{0};
+  if (stacks_settings.per_stack) {
+    const auto title = GetFullWidth("STACKS", true);
+    result.AppendMessage(title.data());
+  }
+
+  auto interpreter = debugger.GetCommandInterpreter();
+  // (task processor, pooled) -> usage
+  std::map<std::pair<std::string, bool>, StacksUsage> usages;
+  StacksUsage all{};
+  StacksUsage pooled{};
+  std::size_t unknown = 0;
+  for (const auto& coroutine : *coroutines) {
+    if (interpreter.WasInterrupted()) {
+      result.Printf("Interrupted while reading residency\n");
+      return true;
+    }
+
+    StacksUsage usage{1, {}};
+    if (residency != nullptr) {
+      const auto pages = residency->Count(coroutine.stack.region);
+      if (!pages.has_value()) {
+        ++unknown;
+        continue;
+      }
+      usage.pages = *pages;
+    }
+
+    const bool is_pooled = IsPooled(coroutine);
+    auto& group = usages[{coroutine.task_processor.value_or(kNoTaskProcessor),
+                          is_pooled}];
+    group.stacks += usage.stacks;
+    group.pages += usage.pages;
+    all.stacks += usage.stacks;
+    all.pages += usage.pages;
+    if (is_pooled) {
+      pooled.stacks += usage.stacks;
+      pooled.pages += usage.pages;
+    }
+
+    if (stacks_settings.per_stack) {
+      result.Printf(
+          "coro stack address: %p | resident: %s | swapped: %s | %s | task "
+          "processor: %s\n",
+          reinterpret_cast<void*>(coroutine.stack.GetStackAddress()),
+          FormatSize(usage.pages.resident * page_size).data(),
+          FormatSize(usage.pages.swapped * page_size).data(),
+          is_pooled ? "pooled" : "in use",
+          coroutine.task_processor.value_or(kNoTaskProcessor).data());
+    }
+  }
+
+  const auto title = GetFullWidth("COROUTINE STACKS", true);
+  result.AppendMessage(title.data());
+  result.Printf(
+      "stack size: %s, mapped with guard page: %s, %zu stacks, %s mapped\n",
+      FormatSize(settings->GetRealStackSize()).data(),
+      FormatSize(settings->GetMmapSize()).data(), all.stacks,
+      FormatSize(all.stacks * settings->GetMmapSize()).data());
+  if (residency != nullptr) {
+    result.Printf("residency from: %s\n", residency->GetSource().data());
+  }
+
+  const std::string* current_task_processor = nullptr;
+  for (const auto& [key, usage] : usages) {
+    const auto& [task_processor, is_pooled] = key;
+    if (current_task_processor == nullptr ||
+        *current_task_processor != task_processor) {
+      current_task_processor = &task_processor;
+      result.Printf("task processor: %s\n", task_processor.data());
+    }
+    PrintUsage(is_pooled ? "pooled" : "in use", usage, stacks_settings.rss,
+               page_size, result);
+  }
+
+  if (residency != nullptr) {
+    const auto resident = all.pages.resident * page_size;
+    const auto usable = all.pages.total * page_size;
+    result.Printf("total resident: %s of %s usable (%.1f%%)\n",
+                  FormatSize(resident).data(), FormatSize(usable).data(),
+                  usable != 0 ? 100.0 * resident / usable : 0.0);
+    result.Printf(
+        "%zu pooled stacks hold %s resident, which is what trimming the "
+        "coroutine pool would reclaim\n",
+        pooled.stacks, FormatSize(pooled.pages.resident * page_size).data());
+    if (unknown != 0) {
+      result.Printf("Failed to read residency of %zu stacks\n", unknown);
+    }
+  }
+
+  return true;
+}
+
+}  // namespace llc2
@@ -0,0 +1,254 @@
+#include "llc2_tasks_cmd.hpp"
+
+#include "discovery.hpp"
+#include "settings.hpp"
+#include "userver.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <lldb/API/SBFrame.h>
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBTarget.h>
+#include <lldb/API/SBThread.h>
+
+namespace llc2 {
+
+namespace {
+
+constexpr std::string_view kNoTaskProcessor = "(none)";
+
+struct AgeBucket final {
+  std::int64_t upper_bound;
+  const char* name;
+};
+
+constexpr std::int64_t kMillisecond = 1'000'000;
+
+constexpr AgeBucket kAgeBuckets[] = {
+    {10 * kMillisecond, "< 10ms"},
+    {100 * kMillisecond, "< 100ms"},
+    {1000 * kMillisecond, "< 1s"},
+    {10'000 * kMillisecond, "< 10s"},
+    {60'000 * kMillisecond, "< 1m"},
+    {600'000 * kMillisecond, "< 10m"},
+    {std::numeric_limits<std::int64_t>::max(), ">= 10m"},
+};
+
+void PrintAgeHistogram(lldb::SBTarget& target,
+                       const std::vector<std::int64_t>& sleep_timepoints,
+                       lldb::SBCommandReturnObject& result) {
+  const auto title = GetFullWidth("SLEEP AGE", true);
+  result.AppendMessage(title.data());
+
+  std::optional<std::int64_t> newest_timestamp;
+  if (!sleep_timepoints.empty()) {
+    newest_timestamp =
+        *std::max_element(sleep_timepoints.begin(), sleep_timepoints.end());
+  }
+  const auto now = GetTargetNow(target, newest_timestamp);
+  if (!now.has_value()) {
+    result.Printf("No sleeping tasks with known sleep start\n");
+    return;
+  }
+  if (now->estimated) {
+    result.Printf(
+        "Target clock is not available, ages are relative to the newest "
+        "engine timestamp\n");
+  }
+
+  std::size_t counts[std::size(kAgeBuckets)]{};
+  std::int64_t oldest = 0;
+  for (const auto timepoint : sleep_timepoints) {
+    const auto age = now->nanoseconds - timepoint;
+    oldest = std::max(oldest, age);
+    for (std::size_t i = 0; i < std::size(kAgeBuckets); ++i) {
+      if (age < kAgeBuckets[i].upper_bound) {
+        ++counts[i];
+        break;
+      }
+    }
+  }
+
+  for (std::size_t i = 0; i < std::size(kAgeBuckets); ++i) {
+    result.Printf("  %-8s %zu\n", kAgeBuckets[i].name, counts[i]);
+  }
+  result.Printf("oldest: %s, see 'llc2 bt --sort age --limit N'\n",
+                FormatDuration(oldest).data());
+}
+
+struct RunningTask final {
+  std::uintptr_t stack_address{};
+  std::uintptr_t task_context{};
+  std::string task_processor;
+  // thread index id and OS thread id, if found
+  std::optional<std::pair<std::uint32_t, lldb::tid_t>> thread;
+};
+
+// Maps coroutine stack address to the thread running it.
+std::unordered_map<std::uintptr_t, lldb::SBThread> MapThreadsToStacks(
+    lldb::SBProcess& process, const std::vector<RegionInfo>& stacks) {
+  std::unordered_map<std::uintptr_t, lldb::SBThread> result;
+  const auto num_threads = process.GetNumThreads();
+  for (std::uint32_t i = 0; i < num_threads; ++i) {
+    auto thread = process.GetThreadAtIndex(i);
+    const auto* region = FindThreadStack(thread, stacks);
+    if (region != nullptr) {
+      result.emplace(region->begin, thread);
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+bool TasksCmd::RealExecute(lldb::SBDebugger debugger, char**,
+                           lldb::SBCommandReturnObject& result) {
+  if (GetSettings() == nullptr) {
+    result.Printf("LLC2 plugin is not initialized\n");
+    return false;
+  }
+  SetTerminalWidth(debugger.GetTerminalWidth());
+
+  auto target = debugger.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.Printf("No target selected\n");
+    return false;
+  }
+  auto process = target.GetProcess();
+  if (!process.IsValid()) {
+    result.Printf("No process launched\n");
+    return false;
+  }
+
+  const ScopeTimer total{result, "llc2 tasks"};
+
+  TaskContextReader task_context_reader{target, result};
+  if (!task_context_reader.IsValid()) {
+    result.Printf(
+        "Failed to find '%s' type, only coroutine states are available\n",
+        kTaskContextTypeName);
+  }
+
+  const auto* decoder = GetDecoder(process, result);
+  if (decoder == nullptr) {
+    return false;
+  }
+  const auto stacks = GetCandidateStacks(process, result);
+  const auto threads = MapThreadsToStacks(process, stacks);
+
+  // (task processor, coroutine status, task state) -> count
+  std::map<std::tuple<std::string, std::string, std::string>, std::size_t>
+      census;
+  std::vector<RunningTask> running_tasks;
+  std::vector<std::int64_t> sleep_timepoints;
+
+  auto interpreter = debugger.GetCommandInterpreter();
+  bool interrupted = false;
+  for (const auto& region : stacks) {
+    if (interpreter.WasInterrupted()) {
+      interrupted = true;
+      break;
+    }
+
+    const auto stack = TryInspectStack(process, result, *decoder, region);
+    if (!stack.has_value()) {
+      continue;
+    }
+
+    const std::string coroutine_status = GetCoroutineStatus(*stack);
+    std::string task_state{"(no task)"};
+    std::string task_processor{kNoTaskProcessor};
+    if (stack->task_context != 0 && task_context_reader.IsValid()) {
+      const auto state = task_context_reader.ReadState(stack->task_context);
+      const auto* state_name =
+          state.has_value() ? task_context_reader.GetStateName(*state)
+                            : nullptr;
+      task_state = state_name != nullptr ? state_name : "(unknown)";
+
+      if (IsFinishedTaskState(state_name) && stack->IsSuspended()) {
+        // idle coroutine in the pool, TaskContext is a leftover
+        task_state = "(idle in pool)";
+      } else {
+        if (kSuspendedTaskState == task_state) {
+          const auto sleep_timepoint =
+              task_context_reader.ReadSleepTimepoint(stack->task_context);
+          if (sleep_timepoint.has_value()) {
+            sleep_timepoints.push_back(*sleep_timepoint);
+          }
+        }
+
+        task_processor =
+            task_context_reader.ReadTaskProcessorName(stack->task_context)
+                .value_or(std::string{kNoTaskProcessor});
+      }
+    }
+
+    if (!stack->IsSuspended()) {
+      RunningTask running{stack->GetStackAddress(), stack->task_context,
+                          task_processor, std::nullopt};
+      const auto thread_it = threads.find(stack->GetStackAddress());
+      if (thread_it != threads.end()) {
+        running.thread.emplace(thread_it->second.GetIndexID(),
+                               thread_it->second.GetThreadID());
+      }
+      running_tasks.push_back(std::move(running));
+    }
+
+    ++census[{task_processor, coroutine_status, task_state}];
+  }
+
+  const auto census_title = GetFullWidth("TASKS BY STATE", true);
+  result.AppendMessage(census_title.data());
+
+  std::size_t total_stacks = 0;
+  const std::string* current_task_processor = nullptr;
+  for (const auto& [key, count] : census) {
+    const auto& [task_processor, coroutine_status, task_state] = key;
+    if (current_task_processor == nullptr ||
+        *current_task_processor != task_processor) {
+      current_task_processor = &task_processor;
+      result.Printf("task processor: %s\n", task_processor.data());
+    }
+    result.Printf("  %-10s %-16s %zu\n", coroutine_status.data(),
+                  task_state.data(), count);
+    total_stacks += count;
+  }
+  result.Printf("total coroutine stacks: %zu\n", total_stacks);
+
+  if (!running_tasks.empty()) {
+    const auto running_title = GetFullWidth("RUNNING TASKS", true);
+    result.AppendMessage(running_title.data());
+    for (const auto& running : running_tasks) {
+      result.Printf("coro stack address: %p | task: %p | task processor: %s",
+                    reinterpret_cast<void*>(running.stack_address),
+                    reinterpret_cast<void*>(running.task_context),
+                    running.task_processor.data());
+      if (running.thread.has_value()) {
+        result.Printf(" | thread #%u (tid %lu)\n", running.thread->first,
+                      static_cast<unsigned long>(running.thread->second));
+      } else {
+        result.Printf(" | thread not found\n");
+      }
+    }
+  }
+
+  PrintAgeHistogram(target, sleep_timepoints, result);
+
+  if (interrupted) {
+    result.Printf("Interrupted, counts are partial\n");
+  }
+
+  return true;
+}
+
+}  // namespace llc2
@@ -0,0 +1,148 @@
+#include "llc2_threads_cmd.hpp"
+
+#include "discovery.hpp"
+#include "settings.hpp"
+#include "userver.hpp"
+#include "utils.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <lldb/API/SBFrame.h>
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBStream.h>
+#include <lldb/API/SBTarget.h>
+#include <lldb/API/SBThread.h>
+
+namespace llc2 {
+
+namespace {
+
+// Prints frames of the thread which are on the coroutine stack, up to
+// WrappedCallImpl, like 'llc2 bt' does. Below them are boost and the task
+// processor worker loop, which every thread has.
+void PrintCoroutineFrames(lldb::SBThread& thread, const RegionInfo& region,
+                          lldb::SBCommandReturnObject& result) {
+  lldb::SBStream stream{};
+  const auto num_frames = thread.GetNumFrames();
+  for (std::uint32_t i = 0; i < num_frames; ++i) {
+    auto frame = thread.GetFrameAtIndex(i);
+    const auto sp = frame.GetSP();
+    if (sp < region.begin || sp >= region.end) {
+      break;
+    }
+
+    const auto* function_name = frame.GetFunctionName();
+    if (function_name != nullptr &&
+        std::string_view{function_name}.find(kUserverWrappedCallImplMark) !=
+            std::string_view::npos) {
+      break;
+    }
+    frame.GetDescription(stream);
+  }
+  result.Printf("%s", stream.GetData() != nullptr ? stream.GetData() : "");
+}
+
+}  // namespace
+
+bool ThreadsCmd::RealExecute(lldb::SBDebugger debugger, char**,
+                             lldb::SBCommandReturnObject& result) {
+  if (GetSettings() == nullptr) {
+    result.Printf("LLC2 plugin is not initialized\n");
+    return false;
+  }
+  SetTerminalWidth(debugger.GetTerminalWidth());
+
+  auto target = debugger.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.Printf("No target selected\n");
+    return false;
+  }
+  auto process = target.GetProcess();
+  if (!process.IsValid()) {
+    result.Printf("No process launched\n");
+    return false;
+  }
+
+  const ScopeTimer total{result, "llc2 threads"};
+
+  // Only stacks threads are on get inspected, so this is cheap regardless of
+  // the number of coroutines.
+  const auto* decoder = GetDecoder(process, result);
+  if (decoder == nullptr) {
+    return false;
+  }
+  const auto stacks = GetCandidateStacks(process, result);
+  TaskContextReader task_context_reader{target, result};
+  auto task_context_type = target.FindFirstType(kTaskContextTypeName);
+
+  auto interpreter = debugger.GetCommandInterpreter();
+  const auto num_threads = process.GetNumThreads();
+  std::size_t running = 0;
+  for (std::uint32_t i = 0; i < num_threads; ++i) {
+    if (interpreter.WasInterrupted()) {
+      result.Printf("Interrupted\n");
+      break;
+    }
+
+    auto thread = process.GetThreadAtIndex(i);
+    const auto* thread_name = thread.GetName();
+    const auto* region = FindThreadStack(thread, stacks);
+    const auto stack =
+        region != nullptr
+            ? TryInspectStack(process, result, *decoder, *region)
+            : std::nullopt;
+
+    auto printed =
+        result.Printf("thread #%u (tid %lu, %s)", thread.GetIndexID(),
+                      static_cast<unsigned long>(thread.GetThreadID()),
+                      thread_name != nullptr ? thread_name : "unnamed");
+    if (!stack.has_value()) {
+      result.Printf(": not running a coroutine\n");
+      continue;
+    }
+    ++running;
+
+    printed += result.Printf(
+        " | coro stack address: %p | task: %p",
+        reinterpret_cast<void*>(stack->GetStackAddress()),
+        reinterpret_cast<void*>(stack->task_context));
+    std::optional<SpanInfo> span_info;
+    if (stack->task_context != 0 && task_context_reader.IsValid()) {
+      const auto state = task_context_reader.ReadState(stack->task_context);
+      const auto* state_name =
+          state.has_value() ? task_context_reader.GetStateName(*state)
+                            : nullptr;
+      const auto task_processor =
+          task_context_reader.ReadTaskProcessorName(stack->task_context);
+      printed += result.Printf(
+          " | task processor: %s | state: %s",
+          task_processor.has_value() ? task_processor->data() : "(none)",
+          state_name != nullptr ? state_name : "(unknown)");
+      // The span is only recorded when a task goes to sleep, so for a running
+      // one it's the span of its last sleep, which may be long gone.
+      span_info = ReadSpanInfo(
+          GetTaskContextValue(target, task_context_type, stack->task_context),
+          process, result);
+    }
+    result.Printf("\n%s\n", std::string{GetDashesSw(printed)}.data());
+
+    if (span_info.has_value()) {
+      printed = result.Printf(
+          "Span at last sleep (name, span_id, trace_id): %s | %s | %s",
+          span_info->name.data(), span_info->span_id.data(),
+          span_info->trace_id.data());
+      result.Printf("\n%s\n", std::string{GetDashesSw(printed)}.data());
+    }
+
+    PrintCoroutineFrames(thread, *region, result);
+  }
+
+  result.Printf("%zu of %u threads are running coroutines\n", running,
+                num_threads);
+  return true;
+}
+
+}  // namespace llc2
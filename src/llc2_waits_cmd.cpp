@@ -0,0 +1,493 @@
+#include "llc2_waits_cmd.hpp"
+
+#include "discovery.hpp"
+#include "registers_guard.hpp"
+#include "settings.hpp"
+#include "userver.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <lldb/API/SBError.h>
+#include <lldb/API/SBFrame.h>
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBTarget.h>
+#include <lldb/API/SBThread.h>
+#include <lldb/API/SBType.h>
+#include <lldb/API/SBValue.h>
+
+namespace llc2 {
+
+namespace {
+
+enum class PrimitiveKind {
+  kTask,
+  kMutex,
+  kCondVar,
+  kFuture,
+  kSemaphore,
+  kWaitList,
+  kUnknown,
+};
+
+struct PrimitiveName final {
+  std::string_view name;
+  PrimitiveKind kind;
+};
+
+// Unqualified names of classes, without template arguments. Matched exactly:
+// a condition variable strategy also references the unique_lock<Mutex> it
+// waits with, and a mutex strategy references the mutex wait list, which
+// mustn't be mistaken for what they wait on.
+constexpr PrimitiveName kPrimitiveNames[] = {
+    {"TaskContext", PrimitiveKind::kTask},
+    {"Task", PrimitiveKind::kTask},
+    {"Mutex", PrimitiveKind::kMutex},
+    {"MutexImpl", PrimitiveKind::kMutex},
+    {"ConditionVariable", PrimitiveKind::kCondVar},
+    {"ConditionVariableAny", PrimitiveKind::kCondVar},
+    // CvWaitStrategy
+    {"Cv", PrimitiveKind::kCondVar},
+    {"Future", PrimitiveKind::kFuture},
+    {"FutureState", PrimitiveKind::kFuture},
+    {"FutureStateBase", PrimitiveKind::kFuture},
+    {"Semaphore", PrimitiveKind::kSemaphore},
+    {"CancellableSemaphore", PrimitiveKind::kSemaphore},
+    {"WaitList", PrimitiveKind::kWaitList},
+    {"WaitListLight", PrimitiveKind::kWaitList},
+};
+
+constexpr std::string_view kWaitStrategySuffix = "WaitStrategy";
+
+// Splits "a::B<c::D>::E" into "a", "B" and "E".
+std::vector<std::string_view> SplitQualifiedName(std::string_view name) {
+  std::vector<std::string_view> components;
+  std::size_t depth = 0;
+  std::size_t begin = 0;
+  std::size_t end = std::string_view::npos;
+  for (std::size_t i = 0; i < name.size(); ++i) {
+    if (name[i] == '<') {
+      if (depth++ == 0) {
+        end = i;
+      }
+    } else if (name[i] == '>') {
+      depth -= depth > 0;
+    } else if (depth == 0 && name.compare(i, 2, "::") == 0) {
+      components.push_back(name.substr(begin, std::min(end, i) - begin));
+      begin = i + 2;
+      end = std::string_view::npos;
+      ++i;
+    }
+  }
+  components.push_back(name.substr(begin, std::min(end, name.size()) - begin));
+  return components;
+}
+
+PrimitiveKind ClassifyPrimitive(std::string_view type_name) {
+  const auto components = SplitQualifiedName(type_name);
+  for (const auto& [name, kind] : kPrimitiveNames) {
+    if (components.back() == name) {
+      return kind;
+    }
+  }
+  return PrimitiveKind::kUnknown;
+}
+
+// What a strategy waits on is told by its own type: either its name
+// ("MutexWaitStrategy"), or the class it's nested in
+// ("ConditionVariableAny<Mutex>::WaitStrategy").
+PrimitiveKind ClassifyWaitStrategy(std::string_view type_name) {
+  const auto components = SplitQualifiedName(type_name);
+  auto name = components.back();
+  if (!EndsWith(name, kWaitStrategySuffix)) {
+    return PrimitiveKind::kUnknown;
+  }
+  name.remove_suffix(kWaitStrategySuffix.size());
+  if (name.empty() && components.size() > 1) {
+    name = components[components.size() - 2];
+  }
+  for (const auto& [primitive_name, kind] : kPrimitiveNames) {
+    if (name == primitive_name) {
+      return kind;
+    }
+  }
+  return PrimitiveKind::kUnknown;
+}
+
+const char* ToString(PrimitiveKind kind) {
+  switch (kind) {
+    case PrimitiveKind::kTask:
+      return "task";
+    case PrimitiveKind::kMutex:
+      return "mutex";
+    case PrimitiveKind::kCondVar:
+      return "condvar";
+    case PrimitiveKind::kFuture:
+      return "future";
+    case PrimitiveKind::kSemaphore:
+      return "semaphore";
+    case PrimitiveKind::kWaitList:
+      return "wait list";
+    case PrimitiveKind::kUnknown:
+      return "unknown";
+  }
+  return "";
+}
+
+struct Primitive final {
+  PrimitiveKind kind{PrimitiveKind::kUnknown};
+  std::string type_name;
+  // TaskContext holding the primitive, if it is known: mutex owner or the
+  // task being waited for.
+  std::uintptr_t owner{0};
+  // indices of waiting coroutines
+  std::vector<std::size_t> waiters;
+};
+
+struct DecodedWait final {
+  std::uintptr_t address{0};
+  PrimitiveKind kind{PrimitiveKind::kUnknown};
+  std::string type_name;
+  std::uintptr_t owner{0};
+};
+
+std::uintptr_t ReadPointer(lldb::SBProcess& process, lldb::addr_t address) {
+  std::uintptr_t pointer{0};
+  lldb::SBError error{};
+  process.ReadMemory(address, &pointer, sizeof(pointer), error);
+  return error.Success() ? pointer : 0;
+}
+
+std::uintptr_t FindOwner(lldb::SBProcess& process, lldb::SBValue& primitive,
+                         PrimitiveKind kind, std::uintptr_t address) {
+  switch (kind) {
+    case PrimitiveKind::kTask:
+      return address;
+    case PrimitiveKind::kMutex: {
+      // std::atomic<TaskContext*> owner_, read it raw to not depend on
+      // libstdc++ atomic internals
+      auto owner = primitive.GetChildMemberWithName("owner_");
+      if (!owner.IsValid()) {
+        return 0;
+      }
+      return ReadPointer(process, owner.GetLoadAddress());
+    }
+    default:
+      return 0;
+  }
+}
+
+// Classifies the dynamic type of the WaitStrategy, then looks through its
+// members for the reference to the primitive of that kind.
+std::optional<DecodedWait> DecodeWaitStrategy(lldb::SBFrame& sleep_frame,
+                                              lldb::SBProcess& process,
+                                              std::uintptr_t task_context,
+                                              std::string& strategy_type) {
+  auto wait_strategy = sleep_frame.FindVariable("wait_strategy");
+  if (!wait_strategy.IsValid()) {
+    return std::nullopt;
+  }
+  if (wait_strategy.GetType().IsReferenceType()) {
+    wait_strategy = wait_strategy.Dereference();
+  }
+  auto dynamic = wait_strategy.GetDynamicValue(lldb::eDynamicDontRunTarget);
+  if (dynamic.IsValid()) {
+    wait_strategy = dynamic;
+  }
+  const auto* type_name = wait_strategy.GetTypeName();
+  strategy_type = type_name != nullptr ? type_name : "(unknown)";
+  const auto kind = ClassifyWaitStrategy(strategy_type);
+  if (kind == PrimitiveKind::kUnknown) {
+    return std::nullopt;
+  }
+
+  const auto num_children = wait_strategy.GetNumChildren();
+  for (std::uint32_t i = 0; i < num_children; ++i) {
+    auto member = wait_strategy.GetChildAtIndex(i);
+    auto member_type = member.GetType();
+    if (!member_type.IsPointerType() && !member_type.IsReferenceType()) {
+      continue;
+    }
+
+    const auto address =
+        static_cast<std::uintptr_t>(member.GetValueAsUnsigned());
+    // strategies usually reference the waiting task as well
+    if (address == 0 || address == task_context) {
+      continue;
+    }
+
+    auto pointee = member.Dereference();
+    const auto* pointee_type = pointee.GetTypeName();
+    if (pointee_type == nullptr) {
+      continue;
+    }
+    if (ClassifyPrimitive(pointee_type) != kind) {
+      continue;
+    }
+
+    return DecodedWait{address, kind, pointee_type,
+                       FindOwner(process, pointee, kind, address)};
+  }
+
+  return std::nullopt;
+}
+
+struct WaitsSettings final {
+  std::size_t top{10};
+  bool invalid{false};
+};
+
+WaitsSettings ParseWaitsSettings(char** cmd) {
+  WaitsSettings result{};
+  for (auto** p = cmd; p != nullptr && *p != nullptr; ++p) {
+    if (std::strcmp(*p, "-n") == 0) {
+      const auto top = ParseCount(*(p + 1));
+      result.invalid |= !top.has_value();
+      result.top = top.value_or(result.top);
+      if (*(p + 1) != nullptr) ++p;
+      continue;
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+bool WaitsCmd::RealExecute(lldb::SBDebugger debugger, char** cmd,
+                           lldb::SBCommandReturnObject& result) {
+  const auto waits_settings = ParseWaitsSettings(cmd);
+  if (waits_settings.invalid) {
+    result.Printf("Failed to parse waits options\n");
+    return false;
+  }
+
+  if (GetSettings() == nullptr) {
+    result.Printf("LLC2 plugin is not initialized\n");
+    return false;
+  }
+  SetTerminalWidth(debugger.GetTerminalWidth());
+
+  auto target = debugger.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.Printf("No target selected\n");
+    return false;
+  }
+  auto process = target.GetProcess();
+  if (!process.IsValid()) {
+    result.Printf("No process launched\n");
+    return false;
+  }
+  auto thread = process.GetSelectedThread();
+  if (!thread.IsValid()) {
+    result.Printf("No thread selected\n");
+    return false;
+  }
+
+  const ScopeTimer total{result, "llc2 waits"};
+
+  auto interpreter = debugger.GetCommandInterpreter();
+
+  std::vector<CoroInfo> coros;
+  {
+    const auto* decoder = GetDecoder(process, result);
+    if (decoder == nullptr) {
+      return false;
+    }
+    const auto candidates = GetCandidateStacks(process, result);
+    ScanProgress discovery_progress{"llc2 waits: discovering coroutines",
+                                    debugger, candidates.size(),
+                                    "candidate stacks"};
+    for (const auto& candidate : candidates) {
+      if (interpreter.WasInterrupted()) {
+        result.Printf(
+            "Interrupted while discovering coroutines: %zu of %zu candidate "
+            "stacks scanned\n",
+            discovery_progress.GetScanned(), discovery_progress.GetTotal());
+        return true;
+      }
+      discovery_progress.Increment();
+
+      auto coro = TryDiscoverCoroutine(process, result, *decoder, candidate);
+      if (coro.has_value()) {
+        coros.push_back(std::move(*coro));
+      }
+    }
+  }
+
+  ScanProgress progress{"llc2 waits", debugger, coros.size()};
+  bool interrupted = false;
+
+  // primitive address -> primitive
+  std::unordered_map<std::uintptr_t, Primitive> primitives;
+  // coroutine index -> address of the primitive it waits on
+  std::unordered_map<std::size_t, std::uintptr_t> waits_on;
+  // strategy type name -> count, for sleeps we couldn't decode
+  std::map<std::string, std::size_t> undecoded;
+
+  {
+    CurrentFrameRegistersGuard regs_guard{thread, result};
+    for (std::size_t i = 0; i < coros.size(); ++i) {
+      if (interpreter.WasInterrupted()) {
+        interrupted = true;
+        break;
+      }
+
+      regs_guard.ChangeRegisters(coros[i].registers);
+      const auto sleep_frame_index = FindSleepFrame(thread);
+      progress.Increment();
+      if (!sleep_frame_index.has_value()) {
+        continue;
+      }
+
+      auto sleep_frame = thread.GetFrameAtIndex(*sleep_frame_index);
+      std::string strategy_type;
+      const auto wait = DecodeWaitStrategy(sleep_frame, process,
+                                           coros[i].task_context,
+                                           strategy_type);
+      if (!wait.has_value()) {
+        ++undecoded[strategy_type];
+        continue;
+      }
+
+      auto& primitive = primitives[wait->address];
+      primitive.kind = wait->kind;
+      primitive.type_name = wait->type_name;
+      primitive.owner = wait->owner;
+      primitive.waiters.push_back(i);
+      waits_on.emplace(i, wait->address);
+    }
+  }
+
+  std::unordered_map<std::uintptr_t, std::size_t> coro_by_task_context;
+  for (std::size_t i = 0; i < coros.size(); ++i) {
+    if (coros[i].task_context != 0) {
+      coro_by_task_context.emplace(coros[i].task_context, i);
+    }
+  }
+
+  auto task_context_type = target.FindFirstType(kTaskContextTypeName);
+  const auto describe_task = [&](std::uintptr_t task_context) {
+    std::string description{"task "};
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%p",
+                  reinterpret_cast<void*>(task_context));
+    description.append(buffer);
+
+    const auto it = coro_by_task_context.find(task_context);
+    if (it != coro_by_task_context.end()) {
+      std::snprintf(
+          buffer, sizeof(buffer), " (coro stack address: %p)",
+          reinterpret_cast<void*>(coros[it->second].GetStackAddress()));
+      description.append(buffer);
+    }
+    if (task_context_type.IsValid()) {
+      const auto span_info = ReadSpanInfo(
+          GetTaskContextValue(target, task_context_type, task_context),
+          process, result);
+      if (span_info.has_value()) {
+        description.append(" span: ").append(span_info->name);
+      }
+    }
+    return description;
+  };
+
+  std::vector<std::pair<std::uintptr_t, const Primitive*>> hottest;
+  hottest.reserve(primitives.size());
+  for (const auto& [address, primitive] : primitives) {
+    hottest.emplace_back(address, &primitive);
+  }
+  std::sort(hottest.begin(), hottest.end(),
+            [](const auto& lhs, const auto& rhs) {
+              return lhs.second->waiters.size() > rhs.second->waiters.size();
+            });
+  if (hottest.size() > waits_settings.top) {
+    hottest.resize(waits_settings.top);
+  }
+
+  const auto primitives_title = GetFullWidth("CONTENDED PRIMITIVES", true);
+  result.AppendMessage(primitives_title.data());
+  for (const auto& [address, primitive] : hottest) {
+    result.Printf("waiters: %zu | %s %p | %s\n", primitive->waiters.size(),
+                  ToString(primitive->kind), reinterpret_cast<void*>(address),
+                  primitive->type_name.data());
+    if (primitive->owner != 0) {
+      result.Printf("  held by: %s\n", describe_task(primitive->owner).data());
+    }
+  }
+  for (const auto& [strategy_type, count] : undecoded) {
+    result.Printf("waiters: %zu | not decoded | %s\n", count,
+                  strategy_type.data());
+  }
+
+  // Every coroutine waits on at most one primitive and every primitive has at
+  // most one owner, so following waiter -> owner edges from each coroutine
+  // either ends or runs into a cycle.
+  const auto cycles_title = GetFullWidth("WAIT CYCLES", true);
+  result.AppendMessage(cycles_title.data());
+
+  const auto next = [&](std::size_t coro_index) -> std::optional<std::size_t> {
+    const auto wait_it = waits_on.find(coro_index);
+    if (wait_it == waits_on.end()) {
+      return std::nullopt;
+    }
+    const auto owner = primitives[wait_it->second].owner;
+    const auto owner_it = coro_by_task_context.find(owner);
+    if (owner == 0 || owner_it == coro_by_task_context.end()) {
+      return std::nullopt;
+    }
+    return owner_it->second;
+  };
+
+  enum class Color { kWhite, kOnPath, kDone };
+  std::vector<Color> colors(coros.size(), Color::kWhite);
+  std::size_t num_cycles = 0;
+  for (std::size_t start = 0; start < coros.size(); ++start) {
+    std::vector<std::size_t> path;
+    std::optional<std::size_t> current = start;
+    while (current.has_value() && colors[*current] == Color::kWhite) {
+      colors[*current] = Color::kOnPath;
+      path.push_back(*current);
+      current = next(*current);
+    }
+
+    if (current.has_value() && colors[*current] == Color::kOnPath) {
+      ++num_cycles;
+      const auto cycle_begin = std::find(path.begin(), path.end(), *current);
+      for (auto it = cycle_begin; it != path.end(); ++it) {
+        const auto primitive_address = waits_on[*it];
+        result.Printf("%s\n  waits on %s %p\n",
+                      describe_task(coros[*it].task_context).data(),
+                      ToString(primitives[primitive_address].kind),
+                      reinterpret_cast<void*>(primitive_address));
+      }
+      result.Printf("  held by: %s\n%s\n",
+                    describe_task(coros[*current].task_context).data(),
+                    std::string{GetDashesSw(40)}.data());
+    }
+
+    for (const auto index : path) {
+      colors[index] = Color::kDone;
+    }
+  }
+  if (num_cycles == 0) {
+    result.Printf("No wait cycles found\n");
+  }
+
+  if (interrupted) {
+    result.Printf(
+        "Interrupted: %zu of %zu coroutines scanned, results are partial\n",
+        progress.GetScanned(), progress.GetTotal());
+  }
+
+  return true;
+}
+
+}  // namespace llc2
@@ -0,0 +1,28 @@
+#include "registers_guard.hpp"
+
+#include <lldb/API/SBData.h>
+#include <lldb/API/SBError.h>
+
+namespace llc2 {
+
+std::int64_t UpdateRegisterValue(lldb::SBValue& general_purpose_registers,
+                                 lldb::SBCommandReturnObject& result,
+                                 const char* reg_name, std::int64_t reg_value) {
+  auto reg_sb_value =
+      general_purpose_registers.GetChildMemberWithName(reg_name);
+
+  lldb::SBData data{};
+  data.SetDataFromSInt64Array(&reg_value, 1);
+
+  const auto prev = reg_sb_value.GetValueAsSigned();
+
+  lldb::SBError error{};
+  reg_sb_value.SetData(data, error);
+  if (!error.Success()) {
+    result.Printf("Failed to update '%s' register\n", reg_name);
+  }
+
+  return prev;
+}
+
+}  // namespace llc2
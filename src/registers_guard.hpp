@@ -0,0 +1,82 @@
+#pragma once
+
+#include "discovery.hpp"
+
+#include <cstdint>
+#include <optional>
+
+#include <lldb/API/SBCommandReturnObject.h>
+#include <lldb/API/SBFrame.h>
+#include <lldb/API/SBThread.h>
+#include <lldb/API/SBValue.h>
+#include <lldb/API/SBValueList.h>
+
+namespace llc2 {
+
+// Returns previous value of the register.
+std::int64_t UpdateRegisterValue(lldb::SBValue& general_purpose_registers,
+                                 lldb::SBCommandReturnObject& result,
+                                 const char* reg_name, std::int64_t reg_value);
+
+// Makes LLDB believe the selected frame of the thread is the suspended
+// coroutine, so that LLDB unwinds it for us. Original registers are restored
+// on destruction.
+class CurrentFrameRegistersGuard final {
+ public:
+  CurrentFrameRegistersGuard(lldb::SBThread& thread,
+                             lldb::SBCommandReturnObject& result)
+      : thread_{thread}, result_{result} {}
+
+  void ChangeRegisters(const UnwindRegisters& regs) {
+    auto [frame, registers] = GetCurrentFrameRegisters();
+
+    const auto old_regs = UpdateRegs(registers, regs);
+    if (!old_registers_.has_value()) {
+      old_registers_.emplace(old_regs);
+    }
+    frame.SetPC(regs.rip);
+  }
+
+  ~CurrentFrameRegistersGuard() {
+    if (!old_registers_.has_value()) {
+      return;
+    }
+    const auto& old_regs = *old_registers_;
+
+    auto [frame, registers] = GetCurrentFrameRegisters();
+    UpdateRegs(registers, old_regs);
+    frame.SetPC(old_regs.rip);
+  }
+
+ private:
+  struct FrameRegisters final {
+    lldb::SBFrame frame;
+    lldb::SBValue registers;
+  };
+
+  FrameRegisters GetCurrentFrameRegisters() {
+    auto frame = thread_.GetSelectedFrame();
+    auto registers =
+        frame.GetRegisters().GetFirstValueByName("General Purpose Registers");
+
+    return {std::move(frame), std::move(registers)};
+  }
+
+  UnwindRegisters UpdateRegs(lldb::SBValue& lldb_registers,
+                             const UnwindRegisters& regs) {
+    const auto old_rsp =
+        UpdateRegisterValue(lldb_registers, result_, "rsp", regs.rsp);
+    const auto old_rbp =
+        UpdateRegisterValue(lldb_registers, result_, "rbp", regs.rbp);
+    const auto old_rip =
+        UpdateRegisterValue(lldb_registers, result_, "rip", regs.rip);
+
+    return {old_rsp, old_rbp, old_rip};
+  }
+
+  lldb::SBThread& thread_;
+  lldb::SBCommandReturnObject& result_;
+  std::optional<UnwindRegisters> old_registers_;
+};
+
+}  // namespace llc2
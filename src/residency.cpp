@@ -0,0 +1,277 @@
+#include "residency.hpp"
+
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <lldb/API/SBFileSpec.h>
+#include <lldb/API/SBPlatform.h>
+
+#if __linux__
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace llc2 {
+
+namespace {
+
+#if __linux__
+
+// Closes file descriptor on destruction.
+class FileDescriptor final {
+ public:
+  explicit FileDescriptor(int fd) : fd_{fd} {}
+  FileDescriptor(const FileDescriptor&) = delete;
+  FileDescriptor& operator=(const FileDescriptor&) = delete;
+  ~FileDescriptor() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  int Get() const { return fd_; }
+
+  int Release() { return std::exchange(fd_, -1); }
+
+ private:
+  int fd_;
+};
+
+// See Documentation/admin-guide/mm/pagemap.rst of the kernel.
+class PagemapReader final : public ResidencyReader {
+ public:
+  PagemapReader(int fd, std::string path)
+      : ResidencyReader{static_cast<std::size_t>(::sysconf(_SC_PAGESIZE))},
+        fd_{fd},
+        path_{std::move(path)} {}
+
+  std::optional<PageCounts> Count(const RegionInfo& region) override {
+    constexpr std::uint64_t kPresent = 1ULL << 63;
+    constexpr std::uint64_t kSwapped = 1ULL << 62;
+
+    PageCounts counts{};
+    counts.total = (region.end - region.begin) / GetPageSize();
+    entries_.resize(counts.total);
+    const auto offset = region.begin / GetPageSize() * sizeof(std::uint64_t);
+    const auto size = entries_.size() * sizeof(std::uint64_t);
+    if (::pread(fd_.Get(), entries_.data(), size, offset) !=
+        static_cast<ssize_t>(size)) {
+      return std::nullopt;
+    }
+
+    for (const auto entry : entries_) {
+      counts.resident += (entry & kPresent) != 0;
+      counts.swapped += (entry & kSwapped) != 0;
+    }
+    return counts;
+  }
+
+  std::string GetSource() const override { return path_; }
+
+ private:
+  FileDescriptor fd_;
+  std::string path_;
+  std::vector<std::uint64_t> entries_;
+};
+
+class CoreFileReader final : public ResidencyReader {
+ public:
+  struct Segment final {
+    std::uint64_t vaddr{};
+    std::uint64_t offset{};
+    std::uint64_t filesz{};
+  };
+
+  // core dumps are written with the page size of the machine they come from,
+  // and we only support x86_64
+  static constexpr std::size_t kPageSize = 4096;
+
+  CoreFileReader(int fd, std::string path, std::vector<Segment> segments)
+      : ResidencyReader{kPageSize},
+        fd_{fd},
+        path_{std::move(path)},
+        segments_{std::move(segments)} {}
+
+  std::optional<PageCounts> Count(const RegionInfo& region) override {
+    PageCounts counts{};
+    counts.total = (region.end - region.begin) / GetPageSize();
+
+    auto segment = std::upper_bound(
+        segments_.begin(), segments_.end(), region.begin,
+        [](std::uint64_t value, const Segment& s) { return value < s.vaddr; });
+    if (segment != segments_.begin()) {
+      --segment;
+    }
+    for (; segment != segments_.end() && segment->vaddr < region.end;
+         ++segment) {
+      // part of the region which is in the file
+      const auto begin = std::max<std::uint64_t>(region.begin, segment->vaddr);
+      const auto end = std::min<std::uint64_t>(
+          region.end, segment->vaddr + segment->filesz);
+      if (begin >= end) {
+        continue;
+      }
+      counts.resident +=
+          CountData(segment->offset + (begin - segment->vaddr),
+                    segment->offset + (end - segment->vaddr));
+    }
+    return counts;
+  }
+
+  std::string GetSource() const override { return path_; }
+
+ private:
+  // Number of pages in [begin, end) of the file which aren't holes. If the
+  // file system doesn't do holes (or the core was copied without keeping
+  // them), that's all of them.
+  std::size_t CountData(std::uint64_t begin, std::uint64_t end) {
+    std::size_t bytes = 0;
+    auto position = static_cast<off_t>(begin);
+    while (position < static_cast<off_t>(end)) {
+      const auto data = ::lseek(fd_.Get(), position, SEEK_DATA);
+      if (data < 0 || data >= static_cast<off_t>(end)) {
+        break;
+      }
+      auto hole = ::lseek(fd_.Get(), data, SEEK_HOLE);
+      if (hole < 0 || hole > static_cast<off_t>(end)) {
+        hole = static_cast<off_t>(end);
+      }
+      bytes += hole - data;
+      position = hole;
+    }
+    return bytes / GetPageSize();
+  }
+
+  FileDescriptor fd_;
+  std::string path_;
+  std::vector<Segment> segments_;
+};
+
+// The kernel always leaves untouched pages as holes, so a core without a
+// single hole in its PT_LOAD segments was copied without keeping them (or
+// decompressed), and every page of it looks resident.
+bool HasHoles(int fd, const std::vector<CoreFileReader::Segment>& segments) {
+  for (const auto& segment : segments) {
+    if (segment.filesz == 0) {
+      continue;
+    }
+    const auto end = static_cast<off_t>(segment.offset + segment.filesz);
+    const auto hole =
+        ::lseek(fd, static_cast<off_t>(segment.offset), SEEK_HOLE);
+    if (hole >= 0 && hole < end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::unique_ptr<ResidencyReader> CreatePagemapReader(
+    lldb::SBProcess& process, lldb::SBCommandReturnObject& result) {
+  const auto path =
+      "/proc/" + std::to_string(process.GetProcessID()) + "/pagemap";
+  const int fd = ::open(path.data(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    result.Printf("Failed to open '%s': %s\n", path.data(),
+                  std::strerror(errno));
+    return nullptr;
+  }
+  return std::make_unique<PagemapReader>(fd, path);
+}
+
+std::unique_ptr<ResidencyReader> CreateCoreFileReader(
+    lldb::SBProcess& process, lldb::SBCommandReturnObject& result) {
+  auto core_file = process.GetCoreFile();
+  char path[4096]{};
+  if (!core_file.IsValid() || core_file.GetPath(path, sizeof(path)) == 0) {
+    result.Printf("Failed to get core file path\n");
+    return nullptr;
+  }
+
+  const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    result.Printf("Failed to open '%s': %s\n", path, std::strerror(errno));
+    return nullptr;
+  }
+  FileDescriptor guard{fd};
+
+  Elf64_Ehdr header{};
+  if (::pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 ||
+      header.e_ident[EI_CLASS] != ELFCLASS64 || header.e_type != ET_CORE ||
+      header.e_phentsize != sizeof(Elf64_Phdr)) {
+    result.Printf("'%s' is not a 64-bit ELF core\n", path);
+    return nullptr;
+  }
+
+  std::vector<Elf64_Phdr> program_headers(header.e_phnum);
+  const auto size = program_headers.size() * sizeof(Elf64_Phdr);
+  if (::pread(fd, program_headers.data(), size, header.e_phoff) !=
+      static_cast<ssize_t>(size)) {
+    result.Printf("Failed to read program headers of '%s'\n", path);
+    return nullptr;
+  }
+
+  std::vector<CoreFileReader::Segment> segments;
+  for (const auto& program_header : program_headers) {
+    if (program_header.p_type == PT_LOAD) {
+      segments.push_back(CoreFileReader::Segment{
+          program_header.p_vaddr, program_header.p_offset,
+          program_header.p_filesz});
+    }
+  }
+  std::sort(segments.begin(), segments.end(),
+            [](const auto& lhs, const auto& rhs) {
+              return lhs.vaddr < rhs.vaddr;
+            });
+
+  if (!HasHoles(fd, segments)) {
+    result.Printf(
+        "Residency is unknown: '%s' has no holes, it was likely copied or "
+        "decompressed without keeping it sparse, and every page would look "
+        "resident\n",
+        path);
+    return nullptr;
+  }
+
+  return std::make_unique<CoreFileReader>(guard.Release(), path,
+                                          std::move(segments));
+}
+
+#endif
+
+}  // namespace
+
+std::unique_ptr<ResidencyReader> ResidencyReader::Create(
+    lldb::SBTarget& target, lldb::SBProcess& process,
+    lldb::SBCommandReturnObject& result) {
+#if __linux__
+  if (IsCore(process)) {
+    return CreateCoreFileReader(process, result);
+  }
+
+  auto platform = target.GetPlatform();
+  const auto* platform_name = platform.GetName();
+  if (platform_name == nullptr || std::string_view{platform_name} != "host") {
+    result.Printf(
+        "Residency of a remote process memory is not available, only of a "
+        "local process or a core\n");
+    return nullptr;
+  }
+  return CreatePagemapReader(process, result);
+#else
+  static_cast<void>(target);
+  static_cast<void>(process);
+  result.Printf("Residency of memory is only available on linux\n");
+  return nullptr;
+#endif
+}
+
+}  // namespace llc2
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "discovery.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <lldb/API/SBCommandReturnObject.h>
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBTarget.h>
+
+namespace llc2 {
+
+struct PageCounts final {
+  std::size_t total{};
+  // in RAM for a live process, dumped for a core
+  std::size_t resident{};
+  // only known for a live process
+  std::size_t swapped{};
+
+  PageCounts& operator+=(const PageCounts& other) {
+    total += other.total;
+    resident += other.resident;
+    swapped += other.swapped;
+    return *this;
+  }
+};
+
+// Tells which pages of process memory are backed by something: for a live
+// local process it's /proc/<pid>/pagemap, for a core it's which pages of
+// PT_LOAD segments are actually in the file (the kernel leaves holes for the
+// pages that were never touched).
+class ResidencyReader {
+ public:
+  // Returns null if residency isn't available for this process, result says
+  // why.
+  static std::unique_ptr<ResidencyReader> Create(
+      lldb::SBTarget& target, lldb::SBProcess& process,
+      lldb::SBCommandReturnObject& result);
+
+  virtual ~ResidencyReader() = default;
+
+  virtual std::optional<PageCounts> Count(const RegionInfo& region) = 0;
+
+  // Where the data comes from, for the report.
+  virtual std::string GetSource() const = 0;
+
+  std::size_t GetPageSize() const { return page_size_; }
+
+ protected:
+  explicit ResidencyReader(std::size_t page_size) : page_size_{page_size} {}
+
+ private:
+  std::size_t page_size_;
+};
+
+}  // namespace llc2
@@ -0,0 +1,239 @@
+#include "snapshot.hpp"
+
+#include "coroutine_index.hpp"
+#include "symbolizer.hpp"
+#include "userver.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <utility>
+
+#include <lldb/API/SBTarget.h>
+
+namespace llc2 {
+
+namespace {
+
+constexpr std::string_view kSnapshotHeader = "llc2 snapshot 2";
+// written in place of an empty span or trace id, to keep fields separated
+constexpr std::string_view kNoId = "-";
+constexpr std::string_view kUnknownFunction = "??";
+
+// FNV-1a
+std::uint64_t HashFrames(const std::vector<const char*>& names,
+                         std::size_t num_frames) {
+  std::uint64_t hash = 14695981039346656037ULL;
+  const auto hash_byte = [&hash](unsigned char c) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  };
+  for (std::size_t i = 0; i < num_frames; ++i) {
+    const std::string_view name =
+        names[i] != nullptr ? names[i] : kUnknownFunction;
+    for (const char c : name) {
+      hash_byte(static_cast<unsigned char>(c));
+    }
+    hash_byte(0);
+  }
+  return hash;
+}
+
+const std::string& ToField(const std::string& id) {
+  static const std::string kNoIdString{kNoId};
+  return id.empty() ? kNoIdString : id;
+}
+
+std::string FromField(std::string field) {
+  return field == kNoId ? std::string{} : field;
+}
+
+}  // namespace
+
+bool SnapshotCoroutine::IsSameSleep(const SnapshotCoroutine& other) const {
+  // without a span or a timepoint there is nothing tasks differ by
+  if (task_context == 0 || (span_id.empty() && sleep_timepoint == 0)) {
+    return false;
+  }
+  return stack_address == other.stack_address &&
+         task_context == other.task_context &&
+         sleep_timepoint == other.sleep_timepoint &&
+         signature == other.signature && span_id == other.span_id &&
+         trace_id == other.trace_id;
+}
+
+std::optional<Snapshot> TakeSnapshot(lldb::SBDebugger& debugger,
+                                     lldb::SBProcess& process,
+                                     const CoroDecoder& decoder,
+                                     lldb::SBCommandReturnObject& result) {
+  const auto* coroutines =
+      GetCoroutineIndex(debugger, process, decoder, result);
+  if (coroutines == nullptr) {
+    return std::nullopt;
+  }
+
+  std::vector<CoroInfo> coros;
+  std::vector<const IndexedCoroutine*> indexed;
+  for (const auto& coroutine : *coroutines) {
+    if (!coroutine.registers.has_value()) {
+      continue;
+    }
+    coros.push_back(CoroInfo{coroutine.stack.region, *coroutine.registers,
+                             coroutine.stack.task_context});
+    indexed.push_back(&coroutine);
+  }
+
+  auto target = process.GetTarget();
+  auto interpreter = debugger.GetCommandInterpreter();
+  const auto stacks = GetSymbolizedStacks(target, process, coros, interpreter);
+  if (!stacks.has_value()) {
+    return std::nullopt;
+  }
+
+  SleepFramesCounter sleep_frames_counter{target};
+  TaskContextReader task_context_reader{target, result};
+  Snapshot snapshot{};
+  for (std::size_t i = 0; i < coros.size(); ++i) {
+    const auto& stack = (*stacks)[i];
+    const auto num_frames = sleep_frames_counter.Count(stack);
+    if (!num_frames.has_value()) {
+      continue;
+    }
+
+    const auto signature = HashFrames(stack.names, *num_frames);
+    auto [it, inserted] = snapshot.signatures.try_emplace(signature);
+    if (inserted) {
+      for (std::size_t j = 0; j < *num_frames; ++j) {
+        it->second.emplace_back(stack.names[j] != nullptr ? stack.names[j]
+                                                          : kUnknownFunction);
+      }
+    }
+
+    SnapshotCoroutine coroutine{};
+    coroutine.stack_address = coros[i].GetStackAddress();
+    coroutine.task_context = coros[i].task_context;
+    if (coroutine.task_context != 0) {
+      coroutine.sleep_timepoint =
+          task_context_reader.ReadSleepTimepoint(coroutine.task_context)
+              .value_or(0);
+    }
+    coroutine.signature = signature;
+    if (const auto& span = indexed[i]->span; span.has_value()) {
+      coroutine.span_id = span->span_id;
+      coroutine.trace_id = span->trace_id;
+      coroutine.span_name = span->name;
+    }
+    snapshot.coroutines.push_back(std::move(coroutine));
+  }
+
+  return snapshot;
+}
+
+bool SaveSnapshot(const Snapshot& snapshot, const std::string& path,
+                  lldb::SBCommandReturnObject& result) {
+  std::ofstream out{path};
+  if (!out) {
+    result.Printf("Failed to open '%s' for writing\n", path.data());
+    return false;
+  }
+
+  char buffer[128];
+  out << kSnapshotHeader << '\n';
+  for (const auto& [signature, frames] : snapshot.signatures) {
+    std::snprintf(buffer, sizeof(buffer), "s %" PRIx64 " %zu\n", signature,
+                  frames.size());
+    out << buffer;
+    for (const auto& frame : frames) {
+      out << frame << '\n';
+    }
+  }
+  for (const auto& coroutine : snapshot.coroutines) {
+    std::snprintf(buffer, sizeof(buffer),
+                  "c %" PRIxPTR " %" PRIxPTR " %" PRId64 " %" PRIx64 " ",
+                  coroutine.stack_address, coroutine.task_context,
+                  coroutine.sleep_timepoint, coroutine.signature);
+    out << buffer << ToField(coroutine.span_id) << ' '
+        << ToField(coroutine.trace_id) << ' ' << coroutine.span_name << '\n';
+  }
+
+  if (!out) {
+    result.Printf("Failed to write snapshot to '%s'\n", path.data());
+    return false;
+  }
+  return true;
+}
+
+std::optional<Snapshot> LoadSnapshot(const std::string& path,
+                                     lldb::SBCommandReturnObject& result) {
+  std::ifstream in{path};
+  if (!in) {
+    result.Printf("Failed to open '%s'\n", path.data());
+    return std::nullopt;
+  }
+
+  std::string line;
+  if (!std::getline(in, line) || line != kSnapshotHeader) {
+    result.Printf(
+        "'%s' is not an llc2 snapshot, or was saved by another version of "
+        "llc2\n",
+        path.data());
+    return std::nullopt;
+  }
+
+  Snapshot snapshot{};
+  std::size_t line_number = 1;
+  while (std::getline(in, line)) {
+    ++line_number;
+    std::istringstream fields{line};
+    std::string kind;
+    fields >> kind;
+    if (kind == "s") {
+      std::uint64_t signature{};
+      std::size_t num_frames{};
+      fields >> std::hex >> signature >> std::dec >> num_frames;
+      auto& frames = snapshot.signatures[signature];
+      for (std::size_t i = 0; fields && i < num_frames; ++i) {
+        if (!std::getline(in, line)) {
+          fields.setstate(std::ios::failbit);
+          break;
+        }
+        ++line_number;
+        frames.push_back(line);
+      }
+    } else if (kind == "c") {
+      SnapshotCoroutine coroutine{};
+      std::string span_id;
+      std::string trace_id;
+      fields >> std::hex >> coroutine.stack_address >> coroutine.task_context >>
+          std::dec >> coroutine.sleep_timepoint >> std::hex >>
+          coroutine.signature >> span_id >> trace_id;
+      if (fields) {
+        coroutine.span_id = FromField(std::move(span_id));
+        coroutine.trace_id = FromField(std::move(trace_id));
+        // span name is the rest of the line after a single space, and may
+        // have spaces itself or be empty
+        std::string span_name;
+        std::getline(fields, span_name);
+        fields.clear();
+        if (!span_name.empty()) {
+          coroutine.span_name = span_name.substr(1);
+        }
+        snapshot.coroutines.push_back(std::move(coroutine));
+      }
+    } else {
+      fields.setstate(std::ios::failbit);
+    }
+
+    if (fields.fail()) {
+      result.Printf("Malformed snapshot '%s' at line %zu\n", path.data(),
+                    line_number);
+      return std::nullopt;
+    }
+  }
+
+  return snapshot;
+}
+
+}  // namespace llc2
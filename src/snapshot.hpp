@@ -0,0 +1,56 @@
+#pragma once
+
+#include "discovery.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <lldb/API/SBCommandReturnObject.h>
+#include <lldb/API/SBDebugger.h>
+#include <lldb/API/SBProcess.h>
+
+namespace llc2 {
+
+// A sleeping coroutine reduced to what is needed to compare populations of
+// them across processes and points in time.
+struct SnapshotCoroutine final {
+  std::uintptr_t stack_address{};
+  // Pooled stacks and TaskContexts are reused, so it takes all of these to
+  // tell a coroutine which hasn't moved from a new task sleeping in the same
+  // place: the span of a task, or the time it went to sleep at, change.
+  std::uintptr_t task_context{};
+  // steady_clock nanoseconds, 0 if TaskContext doesn't record it
+  std::int64_t sleep_timepoint{};
+  // hash of function names of the coroutine frames
+  std::uint64_t signature{};
+  std::string span_id;
+  std::string trace_id;
+  std::string span_name;
+
+  // Whether this is the very same sleep of the very same task as other.
+  bool IsSameSleep(const SnapshotCoroutine& other) const;
+};
+
+struct Snapshot final {
+  std::vector<SnapshotCoroutine> coroutines;
+  // signature -> function names of its frames, innermost first
+  std::unordered_map<std::uint64_t, std::vector<std::string>> signatures;
+};
+
+// Snapshot of sleeping coroutines of the process, unwound by frame pointers.
+// Returns nullopt if interrupted.
+std::optional<Snapshot> TakeSnapshot(lldb::SBDebugger& debugger,
+                                     lldb::SBProcess& process,
+                                     const CoroDecoder& decoder,
+                                     lldb::SBCommandReturnObject& result);
+
+bool SaveSnapshot(const Snapshot& snapshot, const std::string& path,
+                  lldb::SBCommandReturnObject& result);
+
+std::optional<Snapshot> LoadSnapshot(const std::string& path,
+                                     lldb::SBCommandReturnObject& result);
+
+}  // namespace llc2
@@ -0,0 +1,257 @@
+#include "symbolizer.hpp"
+
+#include "userver.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <string_view>
+
+#include <lldb/API/SBAddress.h>
+#include <lldb/API/SBBlock.h>
+#include <lldb/API/SBModule.h>
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBSection.h>
+#include <lldb/API/SBSymbol.h>
+
+namespace llc2 {
+
+namespace {
+
+// Sleep is only looked for this deep, below it are the frames of whatever
+// the coroutine is doing, which are of no interest here.
+constexpr std::size_t kMaxSleepFrameDepth = 8;
+
+bool HasMark(const char* function_name, std::string_view mark) {
+  return function_name != nullptr &&
+         std::string_view{function_name}.find(mark) != std::string_view::npos;
+}
+
+}  // namespace
+
+Symbolizer::Symbolizer(lldb::SBTarget& target) : target_{target} {
+  const auto num_modules = target_.GetNumModules();
+  functions_.resize(num_modules);
+  for (std::uint32_t i = 0; i < num_modules; ++i) {
+    auto module = target_.GetModuleAtIndex(i);
+    const auto num_sections = module.GetNumSections();
+    for (std::size_t j = 0; j < num_sections; ++j) {
+      auto section = module.GetSectionAtIndex(j);
+      if ((section.GetPermissions() & lldb::ePermissionsExecutable) == 0) {
+        continue;
+      }
+      const auto begin = section.GetLoadAddress(target_);
+      // not loaded
+      if (begin == LLDB_INVALID_ADDRESS) {
+        continue;
+      }
+      code_ranges_.push_back(
+          CodeRange{begin, begin + section.GetByteSize(), i});
+    }
+  }
+
+  std::sort(code_ranges_.begin(), code_ranges_.end(),
+            [](const auto& lhs, const auto& rhs) {
+              return lhs.begin < rhs.begin;
+            });
+}
+
+const std::vector<Symbolizer::Function>& Symbolizer::GetFunctions(
+    std::uint32_t module_index) {
+  auto& functions = functions_[module_index];
+  if (functions.has_value()) {
+    return *functions;
+  }
+
+  auto& result = functions.emplace();
+  auto module = target_.GetModuleAtIndex(module_index);
+  const auto num_symbols = module.GetNumSymbols();
+  result.reserve(num_symbols);
+  for (std::size_t i = 0; i < num_symbols; ++i) {
+    auto symbol = module.GetSymbolAtIndex(i);
+    if (symbol.GetType() != lldb::eSymbolTypeCode) {
+      continue;
+    }
+    const auto start = symbol.GetStartAddress().GetLoadAddress(target_);
+    if (start == LLDB_INVALID_ADDRESS) {
+      continue;
+    }
+    const auto end = symbol.GetEndAddress().GetLoadAddress(target_);
+    result.push_back(Function{start, end, symbol.GetDisplayName()});
+  }
+
+  std::sort(result.begin(), result.end(),
+            [](const auto& lhs, const auto& rhs) {
+              return lhs.start < rhs.start;
+            });
+  // Symbols without a size are assumed to span up to the next one.
+  for (std::size_t i = 0; i < result.size(); ++i) {
+    if (result[i].end == LLDB_INVALID_ADDRESS ||
+        result[i].end <= result[i].start) {
+      result[i].end = i + 1 < result.size() ? result[i + 1].start
+                                            : result[i].start + 1;
+    }
+  }
+
+  return result;
+}
+
+std::vector<Symbolizer::Symbol> Symbolizer::Resolve(
+    const std::vector<std::uint64_t>& pcs) {
+  std::vector<Symbol> result(pcs.size());
+
+  std::vector<std::size_t> order(pcs.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&pcs](std::size_t lhs, std::size_t rhs) {
+              return pcs[lhs] < pcs[rhs];
+            });
+
+  // Both PCs and code ranges are sorted, and so are functions within a
+  // range, so every cursor below only moves forward.
+  auto range = code_ranges_.begin();
+  const std::vector<Function>* functions = nullptr;
+  std::vector<Function>::const_iterator function;
+  for (const auto index : order) {
+    const auto pc = pcs[index];
+    while (range != code_ranges_.end() && range->end <= pc) {
+      ++range;
+      functions = nullptr;
+    }
+    if (range == code_ranges_.end()) {
+      break;
+    }
+    if (pc < range->begin) {
+      continue;
+    }
+
+    if (functions == nullptr) {
+      functions = &GetFunctions(range->module_index);
+      // a module may have several code ranges, so we start where pc is
+      function = std::upper_bound(
+          functions->begin(), functions->end(), pc,
+          [](std::uint64_t value, const auto& f) { return value < f.start; });
+      if (function != functions->begin()) {
+        --function;
+      }
+    }
+    while (function != functions->end() &&
+           std::next(function) != functions->end() &&
+           std::next(function)->start <= pc) {
+      ++function;
+    }
+
+    if (function != functions->end() && function->start <= pc &&
+        pc < function->end) {
+      result[index] = Symbol{function->name, function->start};
+    }
+  }
+
+  return result;
+}
+
+Symbolizer& GetSymbolizer(lldb::SBTarget& target) {
+  struct CachedSymbolizer final {
+    std::uint32_t process_id{};
+    std::uint32_t num_modules{};
+    Symbolizer symbolizer;
+  };
+  static std::optional<CachedSymbolizer> cached;
+
+  auto process = target.GetProcess();
+  const auto process_id = process.GetUniqueID();
+  const auto num_modules = target.GetNumModules();
+  if (!cached.has_value() || cached->process_id != process_id ||
+      cached->num_modules != num_modules) {
+    cached.reset();
+    cached.emplace(
+        CachedSymbolizer{process_id, num_modules, Symbolizer{target}});
+  }
+  return cached->symbolizer;
+}
+
+std::optional<std::vector<SymbolizedStack>> GetSymbolizedStacks(
+    lldb::SBTarget& target, lldb::SBProcess& process,
+    const std::vector<CoroInfo>& coros,
+    lldb::SBCommandInterpreter& interpreter) {
+  std::vector<SymbolizedStack> stacks(coros.size());
+  std::vector<std::uint64_t> lookup_pcs;
+  for (std::size_t i = 0; i < coros.size(); ++i) {
+    if (interpreter.WasInterrupted()) {
+      return std::nullopt;
+    }
+    const auto pcs = GetFramePointerPcs(process, coros[i]);
+    stacks[i].pcs.assign(pcs.begin(), pcs.end());
+    for (std::size_t j = 0; j < pcs.size(); ++j) {
+      lookup_pcs.push_back(stacks[i].GetLookupPc(j));
+    }
+  }
+
+  const auto symbols = GetSymbolizer(target).Resolve(lookup_pcs);
+
+  auto symbol = symbols.begin();
+  for (auto& stack : stacks) {
+    stack.names.reserve(stack.pcs.size());
+    stack.function_starts.reserve(stack.pcs.size());
+    for (std::size_t j = 0; j < stack.pcs.size(); ++j, ++symbol) {
+      stack.names.push_back(symbol->name);
+      stack.function_starts.push_back(symbol->start);
+    }
+  }
+  return stacks;
+}
+
+std::vector<std::string> GetInlinedFunctions(lldb::SBTarget& target,
+                                             std::uint64_t pc) {
+  std::vector<std::string> result;
+  auto address = target.ResolveLoadAddress(pc);
+  auto block = address.GetBlock().GetContainingInlinedBlock();
+  while (block.IsValid()) {
+    const auto* name = block.GetInlinedName();
+    result.emplace_back(name != nullptr ? name : "??");
+    block = block.GetParent().GetContainingInlinedBlock();
+  }
+  return result;
+}
+
+SleepFramesCounter::SleepFramesCounter(lldb::SBTarget& target)
+    : target_{target} {}
+
+std::optional<std::size_t> SleepFramesCounter::Count(
+    const SymbolizedStack& stack) {
+  bool has_sleep = false;
+  for (std::size_t i = 0; i < stack.names.size(); ++i) {
+    if (!has_sleep && i < kMaxSleepFrameDepth) {
+      has_sleep = IsSleepFrame(stack, i);
+    }
+    if (HasMark(stack.names[i], kUserverWrappedCallImplMark)) {
+      return has_sleep ? std::optional<std::size_t>{i} : std::nullopt;
+    }
+  }
+
+  return has_sleep ? std::optional<std::size_t>{stack.names.size()}
+                   : std::nullopt;
+}
+
+bool SleepFramesCounter::IsSleepFrame(const SymbolizedStack& stack,
+                                      std::size_t i) {
+  if (HasMark(stack.names[i], kUserverSleepMark)) {
+    return true;
+  }
+
+  const auto pc = stack.GetLookupPc(i);
+  auto it = inlined_sleep_.find(pc);
+  if (it == inlined_sleep_.end()) {
+    bool is_sleep = false;
+    for (const auto& name : GetInlinedFunctions(target_, pc)) {
+      if (HasMark(name.c_str(), kUserverSleepMark)) {
+        is_sleep = true;
+        break;
+      }
+    }
+    it = inlined_sleep_.emplace(pc, is_sleep).first;
+  }
+  return it->second;
+}
+
+}  // namespace llc2
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "discovery.hpp"
+
+#include <lldb/API/SBCommandInterpreter.h>
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBTarget.h>
+
+namespace llc2 {
+
+// Resolves PCs to functions containing them, in bulk.
+//
+// Asking SBTarget about every PC is way too slow for the hundreds of
+// thousands of PCs of a big process. Instead, code symbols of a module are
+// read once into a flat array of function starts sorted by address, and
+// all the PCs are sorted and matched against those arrays in a single
+// merge-style pass. Names are the ones LLDB keeps in its string pool, which
+// are interned and outlive us, so nothing is copied.
+class Symbolizer final {
+ public:
+  struct Symbol final {
+    // null if PC isn't inside of a known function
+    const char* name{nullptr};
+    std::uint64_t start{};
+  };
+
+  explicit Symbolizer(lldb::SBTarget& target);
+
+  // Symbols of pcs, in the same order.
+  std::vector<Symbol> Resolve(const std::vector<std::uint64_t>& pcs);
+
+ private:
+  struct Function final {
+    std::uint64_t start{};
+    std::uint64_t end{};
+    const char* name{nullptr};
+  };
+
+  // Executable part of a module in the address space of the process.
+  struct CodeRange final {
+    std::uint64_t begin{};
+    std::uint64_t end{};
+    std::uint32_t module_index{};
+  };
+
+  // Functions of module, sorted by start, read on first use.
+  const std::vector<Function>& GetFunctions(std::uint32_t module_index);
+
+  lldb::SBTarget target_;
+  std::vector<CodeRange> code_ranges_;
+  std::vector<std::optional<std::vector<Function>>> functions_;
+};
+
+// Symbolizer for the target, reused while the set of loaded modules is the
+// same.
+Symbolizer& GetSymbolizer(lldb::SBTarget& target);
+
+// Backtrace of a coroutine made by following frame pointers, innermost frame
+// first.
+struct SymbolizedStack final {
+  // as found on the stack: coroutine rip and then return addresses
+  std::vector<std::uint64_t> pcs;
+  // functions containing them, null if unknown
+  std::vector<const char*> names;
+  std::vector<std::uint64_t> function_starts;
+
+  // Return addresses point after the call, which may already be in another
+  // function or line, so this is what to look up.
+  std::uint64_t GetLookupPc(std::size_t i) const {
+    return i == 0 ? pcs[i] : pcs[i] - 1;
+  }
+};
+
+// Unwinds coroutines by frame pointers and symbolizes all their PCs in one
+// go. Returns nullopt if interrupted.
+std::optional<std::vector<SymbolizedStack>> GetSymbolizedStacks(
+    lldb::SBTarget& target, lldb::SBProcess& process,
+    const std::vector<CoroInfo>& coros,
+    lldb::SBCommandInterpreter& interpreter);
+
+// Names of functions inlined at pc, innermost first, which LLDB would show
+// as separate frames on top of the containing function. This needs debug
+// info blocks, so it's only meant for frames which are actually printed.
+std::vector<std::string> GetInlinedFunctions(lldb::SBTarget& target,
+                                             std::uint64_t pc);
+
+// Tells sleeping coroutines from the rest by their symbolized stacks.
+//
+// In optimized builds TaskContext::Sleep may be inlined into its caller, and
+// the context switch code may be inlined into it, so function symbols alone
+// don't do: inlined functions of the innermost frames are looked at as well,
+// like FindSleepFrame does with LLDB frames. Those need debug info blocks,
+// so they are cached by PC, coroutines mostly sleep at the same few places.
+class SleepFramesCounter final {
+ public:
+  explicit SleepFramesCounter(lldb::SBTarget& target);
+
+  // Returns the number of frames worth showing, that is up to
+  // WrappedCallImpl, nullopt if coroutine doesn't sleep.
+  std::optional<std::size_t> Count(const SymbolizedStack& stack);
+
+ private:
+  bool IsSleepFrame(const SymbolizedStack& stack, std::size_t i);
+
+  lldb::SBTarget target_;
+  std::unordered_map<std::uint64_t, bool> inlined_sleep_;
+};
+
+}  // namespace llc2
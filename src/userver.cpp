@@ -0,0 +1,217 @@
+#include "userver.hpp"
+
+#include "utils.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+#include <lldb/API/SBAddress.h>
+#include <lldb/API/SBError.h>
+#include <lldb/API/SBFrame.h>
+
+namespace llc2 {
+
+namespace {
+
+// steady_clock::time_point members of TaskContext recording when the task
+// went to sleep, the most precise first. Which of them exist depends on
+// uServer version, the last one is when the task was last queued for
+// execution, so it overestimates sleep duration by the time it then ran.
+constexpr std::string_view kSleepTimepointMembers[] = {
+    "sleep_start_timepoint_",
+    "last_state_change_timepoint_",
+    "task_queue_wait_timepoint_",
+};
+
+// Task states of tasks which are done with the coroutine.
+constexpr std::string_view kFinishedTaskStates[] = {"kCompleted", "kCancelled",
+                                                    "kInvalid"};
+
+}  // namespace
+
+bool IsFinishedTaskState(const char* state_name) {
+  return state_name == nullptr ||
+         std::find(std::begin(kFinishedTaskStates),
+                   std::end(kFinishedTaskStates),
+                   state_name) != std::end(kFinishedTaskStates);
+}
+
+std::optional<SpanInfo> ReadSpanInfo(lldb::SBValue task_context,
+                                     lldb::SBProcess process,
+                                     lldb::SBCommandReturnObject& result) {
+  auto span_ptr =
+      task_context.GetChildMemberWithName("current_span_within_sleep_");
+  if (span_ptr.GetValueAsUnsigned() == 0) {
+    return std::nullopt;
+  }
+
+  auto span_impl =
+      span_ptr.Dereference().GetChildMemberWithName("pimpl_").Dereference();
+
+  auto lldb_name = span_impl.GetChildMemberWithName("name_");
+  auto lldb_span_id = span_impl.GetChildMemberWithName("span_id_");
+  auto lldb_trace_id = span_impl.GetChildMemberWithName("trace_id_");
+
+  const auto name_opt = ReadStdString(
+      process, lldb_name.AddressOf().GetValueAsUnsigned(), result);
+  const auto span_id_opt = ReadStdString(
+      process, lldb_span_id.AddressOf().GetValueAsUnsigned(), result);
+  const auto trace_id_opt = ReadStdString(
+      process, lldb_trace_id.AddressOf().GetValueAsUnsigned(), result);
+
+  const std::string empty_str{"(none)"};
+
+  return SpanInfo{name_opt.value_or(empty_str),
+                  span_id_opt.value_or(empty_str),
+                  trace_id_opt.value_or(empty_str)};
+}
+
+lldb::SBValue GetTaskContextValue(lldb::SBTarget& target,
+                                  lldb::SBType& task_context_type,
+                                  std::uintptr_t task_context) {
+  return target.CreateValueFromAddress(
+      "task_context", lldb::SBAddress{task_context, target}, task_context_type);
+}
+
+TaskContextReader::TaskContextReader(lldb::SBTarget& target,
+                                     lldb::SBCommandReturnObject& result)
+    : process_{target.GetProcess()},
+      result_{result},
+      type_{target.FindFirstType(kTaskContextTypeName)} {
+  if (!type_.IsValid()) {
+    return;
+  }
+
+  // std::atomic<Task::State> state_
+  if (auto state = FindField(type_, "state_"); state.has_value()) {
+    state_.emplace(FieldLayout{state->offset, state->type.GetByteSize()});
+
+    auto enum_type = state->type.GetCanonicalType();
+    if (enum_type.GetNumberOfTemplateArguments() > 0) {
+      enum_type = enum_type.GetTemplateArgumentType(0).GetCanonicalType();
+    }
+    auto enum_members = enum_type.GetEnumMembers();
+    for (std::uint32_t i = 0; i < enum_members.GetSize(); ++i) {
+      auto member = enum_members.GetTypeEnumMemberAtIndex(i);
+      if (member.GetName() != nullptr) {
+        state_names_.emplace(member.GetValueAsUnsigned(), member.GetName());
+      }
+    }
+  }
+
+  // TaskProcessor& task_processor_
+  if (auto task_processor = FindField(type_, "task_processor_");
+      task_processor.has_value()) {
+    task_processor_.emplace(FieldLayout{task_processor->offset,
+                                        sizeof(std::uintptr_t)});
+
+    auto config = FindField(task_processor->type.GetDereferencedType(),
+                            "config_");
+    if (config.has_value()) {
+      auto name = FindField(config->type, "name");
+      if (name.has_value()) {
+        task_processor_name_.emplace(config->offset + name->offset);
+      }
+    }
+  }
+
+  for (const auto member : kSleepTimepointMembers) {
+    if (auto timepoint = FindField(type_, member); timepoint.has_value()) {
+      sleep_timepoint_.emplace(
+          FieldLayout{timepoint->offset, timepoint->type.GetByteSize()});
+      break;
+    }
+  }
+}
+
+std::optional<std::uint64_t> TaskContextReader::ReadState(
+    std::uintptr_t task_context) {
+  if (!state_.has_value()) {
+    return std::nullopt;
+  }
+  return ReadInteger(task_context + state_->offset, state_->size);
+}
+
+const char* TaskContextReader::GetStateName(std::uint64_t state) const {
+  const auto it = state_names_.find(state);
+  return it != state_names_.end() ? it->second.data() : nullptr;
+}
+
+std::optional<std::string> TaskContextReader::ReadTaskProcessorName(
+    std::uintptr_t task_context) {
+  if (!task_processor_.has_value() || !task_processor_name_.has_value()) {
+    return std::nullopt;
+  }
+
+  const auto task_processor = ReadInteger(
+      task_context + task_processor_->offset, task_processor_->size);
+  if (!task_processor.has_value() || *task_processor == 0) {
+    return std::nullopt;
+  }
+
+  const auto it = task_processor_names_.find(*task_processor);
+  if (it != task_processor_names_.end()) {
+    return it->second;
+  }
+  auto name = ReadStdString(process_, *task_processor + *task_processor_name_,
+                            result_);
+  task_processor_names_.emplace(*task_processor, name);
+  return name;
+}
+
+std::optional<std::int64_t> TaskContextReader::ReadSleepTimepoint(
+    std::uintptr_t task_context) {
+  if (!sleep_timepoint_.has_value()) {
+    return std::nullopt;
+  }
+  const auto timepoint = ReadInteger(task_context + sleep_timepoint_->offset,
+                                     sleep_timepoint_->size);
+  // default constructed time_point means it was never set
+  if (!timepoint.has_value() || *timepoint == 0) {
+    return std::nullopt;
+  }
+  return static_cast<std::int64_t>(*timepoint);
+}
+
+std::optional<std::uint64_t> TaskContextReader::ReadInteger(
+    std::uintptr_t address, std::uint64_t size) {
+  if (size == 0 || size > sizeof(std::uint64_t)) {
+    return std::nullopt;
+  }
+
+  // little endian, so narrower integers just end up in lower bytes
+  std::uint64_t value{0};
+  lldb::SBError error{};
+  process_.ReadMemory(address, &value, size, error);
+  if (!error.Success()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+std::optional<std::uint32_t> FindSleepFrame(lldb::SBThread& thread) {
+  const auto num_frames = thread.GetNumFrames();
+  for (std::uint32_t i = 0; i < num_frames; ++i) {
+    const auto* function_name = thread.GetFrameAtIndex(i).GetFunctionName();
+    if (function_name == nullptr) {
+      continue;
+    }
+
+    const std::string_view function_name_sw{function_name};
+    if (function_name_sw.find(kUserverSleepMark) != std::string_view::npos) {
+      // coroutine is running, see BacktraceCoroutine
+      if (i == 0) {
+        return std::nullopt;
+      }
+      return i;
+    }
+    if (function_name_sw.find(kUserverWrappedCallImplMark) !=
+        std::string_view::npos) {
+      break;
+    }
+  }
+
+  return std::nullopt;
+}
+
+}  // namespace llc2
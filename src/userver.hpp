@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <lldb/API/SBCommandReturnObject.h>
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBTarget.h>
+#include <lldb/API/SBThread.h>
+#include <lldb/API/SBType.h>
+#include <lldb/API/SBValue.h>
+
+namespace llc2 {
+
+constexpr std::string_view kUserverSleepMark =
+    "engine::impl::TaskContext::Sleep(";
+constexpr std::string_view kUserverWrappedCallImplMark =
+    "utils::impl::WrappedCallImpl<";
+constexpr std::string_view kTaskContextPointerTypeMark =
+    "engine::impl::TaskContext *";
+constexpr const char* kTaskContextTypeName =
+    "userver::engine::impl::TaskContext";
+// Task::State of a task sleeping in TaskContext::Sleep
+constexpr std::string_view kSuspendedTaskState = "kSuspended";
+
+// Whether task is done with its coroutine: then the coroutine is back in the
+// pool, and TaskContext it points to might as well be already destroyed.
+// Unknown state (nullptr) is treated as such.
+bool IsFinishedTaskState(const char* state_name);
+
+struct SpanInfo final {
+  std::string name;
+  std::string span_id;
+  std::string trace_id;
+};
+
+std::optional<SpanInfo> ReadSpanInfo(lldb::SBValue task_context,
+                                     lldb::SBProcess process,
+                                     lldb::SBCommandReturnObject& result);
+
+// Makes a TaskContext value out of a discovered TaskContext pointer, so that
+// its members can be read without unwinding the coroutine.
+lldb::SBValue GetTaskContextValue(lldb::SBTarget& target,
+                                  lldb::SBType& task_context_type,
+                                  std::uintptr_t task_context);
+
+struct FieldLayout final {
+  std::uint64_t offset{};
+  std::uint64_t size{};
+};
+
+// Reads TaskContext members with plain memory reads, member offsets are
+// resolved once from debug info. This is what makes whole process summaries
+// possible without unwinding every coroutine.
+class TaskContextReader final {
+ public:
+  TaskContextReader(lldb::SBTarget& target,
+                    lldb::SBCommandReturnObject& result);
+
+  // False if there is no TaskContext in debug info.
+  bool IsValid() const { return type_.IsValid(); }
+
+  // Value of TaskContext::state_, that is Task::State
+  std::optional<std::uint64_t> ReadState(std::uintptr_t task_context);
+
+  // Name of Task::State enumerator, nullptr if value isn't one.
+  const char* GetStateName(std::uint64_t state) const;
+
+  // Name of the task processor task belongs to, cached per task processor.
+  std::optional<std::string> ReadTaskProcessorName(
+      std::uintptr_t task_context);
+
+  // steady_clock time (in nanoseconds) task went to sleep at, if TaskContext
+  // records it.
+  std::optional<std::int64_t> ReadSleepTimepoint(std::uintptr_t task_context);
+
+ private:
+  std::optional<std::uint64_t> ReadInteger(std::uintptr_t address,
+                                           std::uint64_t size);
+
+  lldb::SBProcess process_;
+  lldb::SBCommandReturnObject& result_;
+  lldb::SBType type_;
+
+  std::optional<FieldLayout> state_;
+  std::map<std::uint64_t, std::string> state_names_;
+
+  std::optional<FieldLayout> task_processor_;
+  // offset of TaskProcessor::config_.name
+  std::optional<std::uint64_t> task_processor_name_;
+  std::unordered_map<std::uintptr_t, std::optional<std::string>>
+      task_processor_names_;
+
+  std::optional<FieldLayout> sleep_timepoint_;
+};
+
+// Returns index of the TaskContext::Sleep frame of a suspended coroutine,
+// nullopt if there is none or the coroutine is just going to sleep.
+// Only function names are looked at, which is way cheaper than frame
+// descriptions.
+std::optional<std::uint32_t> FindSleepFrame(lldb::SBThread& thread);
+
+}  // namespace llc2
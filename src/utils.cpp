@@ -0,0 +1,270 @@
+#include "utils.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <lldb/API/SBError.h>
+#include <lldb/API/SBPlatform.h>
+
+namespace llc2 {
+
+namespace {
+
+std::uint32_t terminal_width;
+
+std::chrono::steady_clock::time_point Now() {
+  return std::chrono::steady_clock::now();
+}
+
+void PrintDuration(lldb::SBCommandReturnObject& result, const std::string& name,
+                   std::chrono::steady_clock::time_point start,
+                   std::chrono::steady_clock::time_point finish) {
+  result.Printf(
+      "%s duration: %lu"
+      "ms\n",
+      name.data(),
+      std::chrono::duration_cast<std::chrono::milliseconds>(finish - start)
+          .count());
+}
+
+}  // namespace
+
+void SetTerminalWidth(std::uint32_t width) { terminal_width = width; }
+
+std::string GetFullWidth(std::string_view what, bool center) {
+  if (what.size() + 2 > terminal_width) {
+    return std::string{what};
+  }
+
+  const auto num_dashes = (terminal_width - (what.size() + 2)) / 2;
+  std::string result;
+  result.reserve(terminal_width);
+
+  if (center) {
+    result.append(GetDashesSw(num_dashes))
+        .append(" ")
+        .append(what)
+        .append(" ")
+        .append(GetDashesSw(num_dashes));
+  } else {
+    result.append(what).append(" ").append(GetDashesSw(num_dashes * 2));
+  }
+
+  return result;
+}
+
+bool EndsWith(std::string_view source, std::string_view what) {
+  const auto pos = source.find(what);
+  return pos != std::string_view::npos && pos + what.size() == source.size();
+}
+
+// https://bugs.llvm.org/show_bug.cgi?id=24202
+
+// Clang is not emitting debug information for std::string because it was told
+// that libstdc++ provides it. This is a debug size optimization that GCC
+// apparently doesn't perform.
+//
+// So we read strings by hand to not depend on libstdc++ debug info presence.
+std::optional<std::string> ReadStdString(lldb::SBProcess process,
+                                         std::size_t address,
+                                         lldb::SBCommandReturnObject& result) {
+  // let's hope for the best
+  constexpr std::size_t kBufferSize = sizeof(std::string);
+  constexpr std::size_t kMaxLen = 100;
+
+  if (address == 0) {
+    return std::nullopt;
+  }
+
+  char buffer[kBufferSize]{};
+  lldb::SBError error{};
+  process.ReadMemory(address, buffer, kBufferSize, error);
+  if (!error.Success()) {
+    result.Printf("Failed to read std::string from process memory: %s\n",
+                  error.GetCString());
+    return std::nullopt;
+  }
+
+  const auto* fake_str_ptr = reinterpret_cast<std::string*>(buffer);
+
+  const auto* data = fake_str_ptr->data();
+  const auto size = fake_str_ptr->size();
+  if (size > kMaxLen) {
+    return std::nullopt;
+  }
+
+  std::string result_string{};
+  result_string.resize(size);
+
+  process.ReadMemory(reinterpret_cast<std::uintptr_t>(data),
+                     result_string.data(), size, error);
+  if (!error.Success()) {
+    result.Printf("Failed to read std::string from process memory: %s\n",
+                  error.GetCString());
+    return std::nullopt;
+  }
+
+  return {std::move(result_string)};
+}
+
+std::optional<std::size_t> ParseCount(const char* s) {
+  if (s == nullptr) {
+    return std::nullopt;
+  }
+  const std::string_view v{s};
+  char* end = nullptr;
+  const std::size_t count = std::strtoul(v.data(), &end, 10);
+  if (v.empty() || end != v.data() + v.size()) {
+    return std::nullopt;
+  }
+  return count;
+}
+
+std::optional<FoundField> FindField(lldb::SBType type, std::string_view name) {
+  for (std::uint32_t i = 0; i < type.GetNumberOfFields(); ++i) {
+    auto field = type.GetFieldAtIndex(i);
+    const auto* field_name = field.GetName();
+    if (field_name != nullptr && name == field_name) {
+      return FoundField{field.GetOffsetInBytes(), field.GetType()};
+    }
+  }
+  for (std::uint32_t i = 0; i < type.GetNumberOfDirectBaseClasses(); ++i) {
+    auto base = type.GetDirectBaseClassAtIndex(i);
+    auto found = FindField(base.GetType(), name);
+    if (found.has_value()) {
+      found->offset += base.GetOffsetInBytes();
+      return found;
+    }
+  }
+  return std::nullopt;
+}
+
+void AppendJsonString(std::string& out, std::string_view s) {
+  out.push_back('"');
+  for (const char c : s) {
+    switch (c) {
+      case '"':
+        out.append("\\\"");
+        break;
+      case '\\':
+        out.append("\\\\");
+        break;
+      case '\n':
+        out.append("\\n");
+        break;
+      case '\t':
+        out.append("\\t");
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buffer[8];
+          std::snprintf(buffer, sizeof(buffer), "\\u%04x",
+                        static_cast<unsigned int>(c));
+          out.append(buffer);
+        } else {
+          out.push_back(c);
+        }
+    }
+  }
+  out.push_back('"');
+}
+
+bool IsCore(lldb::SBProcess& process) {
+  const auto* plugin_name = process.GetPluginName();
+  return plugin_name != nullptr &&
+         std::string_view{plugin_name}.find("core") != std::string_view::npos;
+}
+
+std::optional<TargetNow> GetTargetNow(
+    lldb::SBTarget& target, std::optional<std::int64_t> newest_timestamp) {
+  auto process = target.GetProcess();
+  auto platform = target.GetPlatform();
+  const auto* platform_name = platform.GetName();
+  const bool local = platform_name != nullptr &&
+                     std::string_view{platform_name} == "host";
+
+  // libstdc++ steady_clock is CLOCK_MONOTONIC, which is system-wide
+  if (local && !IsCore(process)) {
+    return TargetNow{std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         Now().time_since_epoch())
+                         .count(),
+                     false};
+  }
+
+  if (newest_timestamp.has_value()) {
+    return TargetNow{*newest_timestamp, true};
+  }
+  return std::nullopt;
+}
+
+std::string FormatDuration(std::int64_t nanoseconds) {
+  constexpr std::int64_t kMillisecond = 1'000'000;
+  constexpr std::int64_t kSecond = 1000 * kMillisecond;
+  constexpr std::int64_t kMinute = 60 * kSecond;
+
+  char buffer[32];
+  if (nanoseconds < kSecond) {
+    std::snprintf(buffer, sizeof(buffer), "%ldms",
+                  static_cast<long>(nanoseconds / kMillisecond));
+  } else if (nanoseconds < kMinute) {
+    std::snprintf(buffer, sizeof(buffer), "%.1fs",
+                  static_cast<double>(nanoseconds) / kSecond);
+  } else {
+    std::snprintf(buffer, sizeof(buffer), "%ldm%lds",
+                  static_cast<long>(nanoseconds / kMinute),
+                  static_cast<long>(nanoseconds % kMinute / kSecond));
+  }
+  return buffer;
+}
+
+std::string FormatSize(std::size_t bytes) {
+  constexpr std::size_t kKiB = 1024;
+  constexpr std::size_t kMiB = 1024 * kKiB;
+  constexpr std::size_t kGiB = 1024 * kMiB;
+
+  char buffer[32];
+  if (bytes < kMiB) {
+    std::snprintf(buffer, sizeof(buffer), "%zuKiB", bytes / kKiB);
+  } else if (bytes < kGiB) {
+    std::snprintf(buffer, sizeof(buffer), "%.1fMiB",
+                  static_cast<double>(bytes) / kMiB);
+  } else {
+    std::snprintf(buffer, sizeof(buffer), "%.2fGiB",
+                  static_cast<double>(bytes) / kGiB);
+  }
+  return buffer;
+}
+
+ScopeTimer::ScopeTimer(lldb::SBCommandReturnObject& result, std::string name)
+    : name{std::move(name)}, start{Now()}, result{result} {}
+
+ScopeTimer::~ScopeTimer() {
+  if (armed_) {
+    PrintDuration(result, name, start, Now());
+  }
+}
+
+ScanProgress::ScanProgress(const char* title, lldb::SBDebugger& debugger,
+                           std::size_t total, const char* unit)
+    : total_{total},
+      unit_{unit}
+#if LLC2_HAS_SB_PROGRESS
+      ,
+      progress_{title, nullptr, total, debugger}
+#endif
+{
+  static_cast<void>(title);
+  static_cast<void>(debugger);
+}
+
+void ScanProgress::Increment() {
+  ++scanned_;
+#if LLC2_HAS_SB_PROGRESS
+  char details[64];
+  std::snprintf(details, sizeof(details), "%zu of %zu %s scanned", scanned_,
+                total_, unit_);
+  progress_.Increment(1, details);
+#endif
+}
+
+}  // namespace llc2
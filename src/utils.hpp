@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <lldb/API/SBCommandReturnObject.h>
+#include <lldb/API/SBDebugger.h>
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBTarget.h>
+#include <lldb/API/SBType.h>
+
+#if __has_include(<lldb/API/SBProgress.h>)
+#include <lldb/API/SBProgress.h>
+#define LLC2_HAS_SB_PROGRESS 1
+#endif
+
+namespace llc2 {
+
+constexpr std::string_view kLotsOfDashes =
+    "--------------------------------------------------------------------------"
+    "--------------------------------------------------------------------------"
+    "---------------------------------------------------";
+
+constexpr std::string_view GetDashesSw(std::size_t size) {
+  return kLotsOfDashes.substr(0, std::min(kLotsOfDashes.size(), size));
+}
+
+// Should be called by every command before it prints anything.
+void SetTerminalWidth(std::uint32_t width);
+
+std::string GetFullWidth(std::string_view what, bool center);
+
+bool EndsWith(std::string_view source, std::string_view what);
+
+std::optional<std::string> ReadStdString(lldb::SBProcess process,
+                                         std::size_t address,
+                                         lldb::SBCommandReturnObject& result);
+
+// Parses a non-negative decimal number, nullopt if s isn't one.
+std::optional<std::size_t> ParseCount(const char* s);
+
+struct FoundField final {
+  std::uint64_t offset{};
+  lldb::SBType type;
+};
+
+// Looks for a member in type and its bases, offset is from the start of type.
+std::optional<FoundField> FindField(lldb::SBType type, std::string_view name);
+
+// Appends s to out as a JSON string, quotes included.
+void AppendJsonString(std::string& out, std::string_view s);
+
+// Whether process is a core dump rather than a live one.
+bool IsCore(lldb::SBProcess& process);
+
+// Monotonic time of the target, in steady_clock nanoseconds.
+struct TargetNow final {
+  std::int64_t nanoseconds{};
+  // whether this is an estimate rather than the target clock
+  bool estimated{false};
+};
+
+// For a live local process target clock is our clock. Otherwise (cores,
+// remote targets) the best we have is the newest steady_clock value the
+// engine has recorded: newest_timestamp, if any.
+std::optional<TargetNow> GetTargetNow(
+    lldb::SBTarget& target, std::optional<std::int64_t> newest_timestamp);
+
+// Human readable duration, like "1.5s" or "250ms".
+std::string FormatDuration(std::int64_t nanoseconds);
+
+// Human readable size, like "1.5MiB" or "12KiB".
+std::string FormatSize(std::size_t bytes);
+
+struct ScopeTimer final {
+  std::string name;
+  std::chrono::steady_clock::time_point start;
+  lldb::SBCommandReturnObject& result;
+
+  ScopeTimer(lldb::SBCommandReturnObject& result, std::string name);
+
+  ~ScopeTimer();
+
+  void Disarm() { armed_ = false; }
+
+ private:
+  bool armed_{true};
+};
+
+// Reports "N of M <unit> scanned" via LLDB progress events, so IDEs and the
+// lldb statusline can show how far a long scan has got.
+// SBProgress is only available in recent LLDB, older ones get nothing.
+class ScanProgress final {
+ public:
+  ScanProgress(const char* title, lldb::SBDebugger& debugger,
+               std::size_t total, const char* unit = "coroutines");
+
+  void Increment();
+
+  std::size_t GetScanned() const { return scanned_; }
+  std::size_t GetTotal() const { return total_; }
+
+ private:
+  std::size_t total_;
+  std::size_t scanned_{0};
+  const char* unit_;
+#if LLC2_HAS_SB_PROGRESS
+  lldb::SBProgress progress_;
+#endif
+};
+
+}  // namespace llc2
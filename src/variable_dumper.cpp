@@ -0,0 +1,188 @@
+#include "variable_dumper.hpp"
+
+#include <string_view>
+
+#include <lldb/API/SBType.h>
+
+namespace llc2 {
+
+namespace {
+
+constexpr lldb::addr_t kInvalidAddress = ~lldb::addr_t{0};
+
+const char* OrNone(const char* s) { return s != nullptr ? s : "(none)"; }
+
+void Indent(lldb::SBStream& stream, std::uint32_t depth) {
+  stream.Printf("%*s", static_cast<int>(depth * 2), "");
+}
+
+// C strings are pointers LLDB has a summary for, that is the string itself.
+// This is decided by type and not by the summary of the first value seen,
+// because a null one has no summary.
+bool IsCharPointer(lldb::SBType type) {
+  if (!type.IsPointerType()) {
+    return false;
+  }
+  const auto* pointee_name =
+      type.GetPointeeType().GetCanonicalType().GetUnqualifiedType().GetName();
+  if (pointee_name == nullptr) {
+    return false;
+  }
+  const std::string_view pointee_name_sw{pointee_name};
+  return pointee_name_sw == "char" || pointee_name_sw == "signed char" ||
+         pointee_name_sw == "unsigned char" || pointee_name_sw == "char8_t";
+}
+
+}  // namespace
+
+VariableDumper::VariableDumper(VariableLimits limits) : limits_{limits} {}
+
+void VariableDumper::StartCoroutine(std::uintptr_t stack_address) {
+  current_stack_address_ = stack_address;
+  used_bytes_ = 0;
+  budget_exhausted_ = false;
+}
+
+bool VariableDumper::Dump(lldb::SBValue value, lldb::SBStream& stream) {
+  if (budget_exhausted_) {
+    return false;
+  }
+
+  dump_start_ = stream.GetSize();
+  if (BudgetExhausted(stream)) {
+    budget_exhausted_ = true;
+    stream.Printf("<variables output limit of %zu bytes reached>\n",
+                  limits_.max_bytes);
+    return false;
+  }
+
+  DumpValue(value, value.GetName(), 0, stream);
+  used_bytes_ += stream.GetSize() - dump_start_;
+  return true;
+}
+
+VariableDumper::TypeFormat VariableDumper::GetTypeFormat(
+    lldb::SBValue& value) {
+  const auto* type_name = value.GetTypeName();
+  if (type_name != nullptr) {
+    const auto it = type_formats_.find(type_name);
+    if (it != type_formats_.end()) {
+      return it->second;
+    }
+  }
+
+  auto type = value.GetType();
+  TypeFormat format = TypeFormat::kScalar;
+  if (type.IsReferenceType()) {
+    format = TypeFormat::kReference;
+  } else if (IsCharPointer(type)) {
+    format = TypeFormat::kSummary;
+  } else if (type.IsPointerType()) {
+    format = TypeFormat::kPointer;
+  } else if (value.IsSynthetic()) {
+    // containers, optionals and the like: their summary ("size=3") doesn't
+    // replace the elements, which are expanded under the limits
+    format = TypeFormat::kAggregate;
+  } else if (value.GetSummary() != nullptr) {
+    // strings and the like, the summary is the whole value
+    format = TypeFormat::kSummary;
+  } else if (value.MightHaveChildren()) {
+    format = TypeFormat::kAggregate;
+  }
+
+  if (type_name != nullptr) {
+    type_formats_.emplace(type_name, format);
+  }
+  return format;
+}
+
+bool VariableDumper::DumpValue(lldb::SBValue value, const char* name,
+                               std::uint32_t depth, lldb::SBStream& stream) {
+  auto format = GetTypeFormat(value);
+  if (format == TypeFormat::kReference) {
+    value = value.Dereference();
+    format = value.IsValid() ? GetTypeFormat(value) : TypeFormat::kScalar;
+  }
+
+  Indent(stream, depth);
+  stream.Printf("(%s) %s = ", OrNone(value.GetDisplayTypeName()),
+                OrNone(name));
+
+  switch (format) {
+    case TypeFormat::kScalar:
+    case TypeFormat::kPointer:
+    case TypeFormat::kReference:
+      stream.Printf("%s\n", OrNone(value.GetValue()));
+      return true;
+    case TypeFormat::kSummary: {
+      // null or unreadable C strings have no summary, only an address
+      const auto* summary = value.GetSummary();
+      stream.Printf("%s\n",
+                    OrNone(summary != nullptr ? summary : value.GetValue()));
+      return true;
+    }
+    case TypeFormat::kAggregate:
+      break;
+  }
+
+  // "size=3" of a container goes before its elements
+  if (const auto* summary = value.GetSummary(); summary != nullptr) {
+    stream.Printf("%s ", summary);
+  }
+
+  if (depth >= limits_.max_depth) {
+    stream.Printf("{...}\n");
+    return false;
+  }
+
+  const auto address = value.GetLoadAddress();
+  const bool addressable =
+      address != kInvalidAddress && value.GetTypeName() != nullptr;
+  if (addressable) {
+    const auto it =
+        printed_.find(std::make_pair(value.GetTypeName(), address));
+    if (it != printed_.end()) {
+      stream.Printf("<%p, printed above for coro %p>\n",
+                    reinterpret_cast<void*>(address),
+                    reinterpret_cast<void*>(it->second));
+      return true;
+    }
+  }
+
+  // Don't let LLDB compute more children than we are going to print,
+  // synthetic children providers of huge containers are slow.
+  const auto num_children = value.GetNumChildren(limits_.max_children + 1);
+  bool complete = num_children <= limits_.max_children;
+  stream.Printf("{\n");
+  for (std::uint32_t i = 0; i < num_children && i < limits_.max_children;
+       ++i) {
+    if (BudgetExhausted(stream)) {
+      Indent(stream, depth + 1);
+      stream.Printf("...\n");
+      complete = false;
+      break;
+    }
+
+    auto child = value.GetChildAtIndex(i);
+    complete &= DumpValue(child, child.GetName(), depth + 1, stream);
+  }
+  if (num_children > limits_.max_children) {
+    Indent(stream, depth + 1);
+    stream.Printf("...\n");
+  }
+  Indent(stream, depth);
+  stream.Printf("}\n");
+
+  // Only what was shown in full may be referred to later.
+  if (complete && addressable) {
+    printed_.emplace(std::make_pair(value.GetTypeName(), address),
+                     current_stack_address_);
+  }
+  return complete;
+}
+
+bool VariableDumper::BudgetExhausted(lldb::SBStream& stream) const {
+  return used_bytes_ + (stream.GetSize() - dump_start_) >= limits_.max_bytes;
+}
+
+}  // namespace llc2
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+#include <lldb/API/SBStream.h>
+#include <lldb/API/SBValue.h>
+
+namespace llc2 {
+
+struct VariableLimits final {
+  // how many levels of nested members to expand
+  std::uint32_t max_depth{3};
+  // how many children of a single value to print
+  std::uint32_t max_children{32};
+  // how many bytes of variables output a single coroutine may produce
+  std::size_t max_bytes{64 * 1024};
+};
+
+// Renders frame variables within configured limits, which is what
+// SBValue::GetDescription doesn't do: it happily expands a container with
+// millions of elements.
+//
+// An instance is meant to live through the whole 'llc2 bt' invocation, so
+// that per-type decisions are only made once and objects shared by many
+// coroutines (handlers, components) are only printed once.
+class VariableDumper final {
+ public:
+  explicit VariableDumper(VariableLimits limits);
+
+  // Resets byte budget, should be called before dumping coroutine variables.
+  void StartCoroutine(std::uintptr_t stack_address);
+
+  // Returns false if byte budget is exhausted and nothing was printed.
+  bool Dump(lldb::SBValue value, lldb::SBStream& stream);
+
+  // True once Dump has returned false for the current coroutine.
+  bool IsBudgetExhausted() const { return budget_exhausted_; }
+
+ private:
+  enum class TypeFormat {
+    // nothing to expand, value is printed as is
+    kScalar,
+    // LLDB has a summary and no synthetic children for the type, summary is
+    // printed instead of children
+    kSummary,
+    // pointers are never followed
+    kPointer,
+    // value is printed in place of its referent
+    kReference,
+    // members (or synthetic children) are printed one by one
+    kAggregate,
+  };
+
+  TypeFormat GetTypeFormat(lldb::SBValue& value);
+
+  // Returns false if the value was cut short by one of the limits.
+  bool DumpValue(lldb::SBValue value, const char* name, std::uint32_t depth,
+                 lldb::SBStream& stream);
+
+  bool BudgetExhausted(lldb::SBStream& stream) const;
+
+  const VariableLimits limits_;
+
+  // Keyed by type name, which LLDB interns, so pointer comparison is enough.
+  std::unordered_map<const char*, TypeFormat> type_formats_;
+  // (type name, address) of aggregates already printed in full -> coroutine
+  // they were printed for.
+  std::map<std::pair<const char*, lldb::addr_t>, std::uintptr_t> printed_;
+
+  std::uintptr_t current_stack_address_{0};
+  // bytes printed for the current coroutine before the ongoing Dump
+  std::size_t used_bytes_{0};
+  // stream size when the ongoing Dump started
+  std::size_t dump_start_{0};
+  bool budget_exhausted_{false};
+};
+
+}  // namespace llc2